@@ -1,6 +1,6 @@
 #!/bin/bash
 
-printf "\t%s\t%s\t\t%s\n" "msg size" "mmap" "socket"
+printf "\t%s\t%s\t\t%s\t\t%s\t\t%s\t%s\t\t%s\t\t%s\n" "msg size" "mmap" "socket" "uring" "uring-sqpoll" "tcp" "inproc" "socket-credits"
 
 for i in {1,8,16,64,128,256,512,1024,2048,4096,16384};
 do
@@ -8,5 +8,15 @@ do
   ./build/bench mmap $i | ./walltime.sh;
   echo -en "\t";
   ./build/bench socket $i | ./walltime.sh;
+  echo -en "\t";
+  ./build/bench uring $i | ./walltime.sh;
+  echo -en "\t";
+  ./build/bench uring-sqpoll $i | ./walltime.sh;
+  echo -en "\t";
+  ./build/bench tcp $i | ./walltime.sh;
+  echo -en "\t";
+  ./build/bench inproc $i | ./walltime.sh;
+  echo -en "\t";
+  ./build/bench socket-credits $i | ./walltime.sh;
   echo "";
 done
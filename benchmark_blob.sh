@@ -0,0 +1,14 @@
+#!/bin/bash
+
+printf "\t%s\t%s\t\t%s\t\t%s\n" "blob MB" "socket" "memfd" "memfd-sealed"
+
+for i in {1,2,4,8,16,32,64};
+do
+  printf "\t%05s\t\t" $i;
+  ./build/blob_bench socket $i | ./walltime.sh;
+  echo -en "\t";
+  ./build/blob_bench memfd $i | ./walltime.sh;
+  echo -en "\t";
+  ./build/blob_bench memfd-sealed $i | ./walltime.sh;
+  echo "";
+done
@@ -0,0 +1,16 @@
+#!/bin/bash
+
+# one core shared by both processes, two cores, and left to the scheduler
+placements=("0 0" "-1 -1")
+if [ "$(nproc)" -gt 1 ]; then
+  placements=("0 0" "0 1" "-1 -1")
+fi
+
+for mode in lock wake pingpong;
+do
+  for cpus in "${placements[@]}";
+  do
+    echo "== $mode, cpus: $cpus"
+    ./build/psync_bench $mode 100000 $cpus | grep '^\['
+  done
+done
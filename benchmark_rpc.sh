@@ -0,0 +1,14 @@
+#!/bin/bash
+
+printf "\t%s\t%s\t\t%s\t\t%s\n" "msg size" "mmap" "socket" "duplex"
+
+for i in {8,64,512,4096};
+do
+  printf "\t%05s\t\t" $i;
+  ./build/rpc_bench mmap $i | ./walltime.sh;
+  echo -en "\t";
+  ./build/rpc_bench socket $i | ./walltime.sh;
+  echo -en "\t";
+  ./build/rpc_bench duplex $i | ./walltime.sh;
+  echo "";
+done
@@ -0,0 +1,187 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "channels/channel.h"
+#include "channels/duplex.h"
+
+#define MMAP_SHARED_MEM_NAME  "/ipc_shr_open_mmap_attach_78328"
+#define DUPLEX_MEM_NAME       "/ipc_shr_open_duplex_attach_78329"
+#define DEFAULT_ITERS         10000
+#define DEFAULT_UNIT_SIZE     8
+
+typedef enum
+{
+  ATTACH_MODE_MMAP,
+  ATTACH_MODE_DUPLEX,
+} attach_mode_t;
+
+static const char * mode_names[] = { "mmap", "duplex" };
+
+static void report_time(const char * label)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  printf("%s: %ld %09ld\n", label, ts.tv_sec, ts.tv_nsec);
+}
+
+static double now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+struct attach_options
+{
+  size_t          unit_size;
+  size_t          iters;
+  attach_mode_t   mode;
+};
+
+static void print_usage(const char * command)
+{
+  printf("USAGE: %s {mmap|duplex} [unit-size] [iters]\n", command);
+  printf("\n");
+  printf(" - {mmap|duplex} - kind of the shared segment\n");
+  printf(" - [unit-size]   - size of a message transmitted over channel\n");
+  printf("                   MUST be a power of 2, defaults to 8\n");
+  printf(" - [iters]       - number of attach/detach cycles\n");
+  printf("                   defaults to 10000\n");
+  printf("\n");
+  printf("   ex: %s mmap 64\n", command);
+  printf("\n");
+  printf(" [COLD] creates and releases the segment on every cycle,\n");
+  printf(" [WARM] attaches to a segment kept initialized by another holder,\n");
+  printf(" [BEGIN]/[-END-] enclose the warm cycles.\n");
+}
+
+static struct attach_options demand_options(int argc, char ** argv);
+
+static void * attach(struct attach_options opts)
+{
+  void * holder = NULL;
+
+  switch (opts.mode)
+  {
+    case ATTACH_MODE_MMAP:
+      holder = ipc_channel_create(MMAP_SHARED_MEM_NAME,
+                                  opts.unit_size,
+                                  IPC_CHANNEL_FLAVOR_MMAP);
+      break;
+
+    case ATTACH_MODE_DUPLEX:
+      holder = ipc_duplex_create(DUPLEX_MEM_NAME,
+                                 opts.unit_size,
+                                 IPC_DUPLEX_CLIENT);
+      break;
+  }
+
+  assert(holder != NULL);
+  return holder;
+}
+
+static void detach(struct attach_options opts, void * holder)
+{
+  switch (opts.mode)
+  {
+    case ATTACH_MODE_MMAP:
+      ((ipc_channel_api_t *) holder)->destroy(holder);
+      break;
+
+    case ATTACH_MODE_DUPLEX:
+      ipc_duplex_destroy(holder);
+      break;
+  }
+}
+
+int main(int argc, char ** argv)
+{
+  struct attach_options opts = demand_options(argc, argv);
+  double begin;
+
+  shm_unlink(MMAP_SHARED_MEM_NAME);
+  shm_unlink(DUPLEX_MEM_NAME);
+
+  begin = now_ns();
+  for (size_t i = 0; i < opts.iters; i++)
+  {
+    detach(opts, attach(opts));
+  }
+  printf("[COLD]: %.1f ns\n", (now_ns() - begin) / opts.iters);
+
+  void * keeper = attach(opts);
+
+  report_time("[BEGIN]");
+  begin = now_ns();
+  for (size_t i = 0; i < opts.iters; i++)
+  {
+    detach(opts, attach(opts));
+  }
+  printf("[WARM]: %.1f ns\n", (now_ns() - begin) / opts.iters);
+  report_time("[-END-]");
+
+  detach(opts, keeper);
+}
+
+static struct attach_options demand_options(int argc, char ** argv)
+{
+  struct attach_options opts =
+  {
+    .unit_size = DEFAULT_UNIT_SIZE,
+    .iters     = DEFAULT_ITERS,
+  };
+
+  if (argc == 1 || argc > 4)
+  {
+    print_usage(argv[0]);
+    exit(0);
+  }
+
+  if (argc >= 2)
+  {
+    if (!strcmp(argv[1], "mmap"))
+      opts.mode = ATTACH_MODE_MMAP;
+    else if (!strcmp(argv[1], "duplex"))
+      opts.mode = ATTACH_MODE_DUPLEX;
+    else
+    {
+      print_usage(argv[0]);
+      exit(0);
+    }
+  }
+
+  if (argc >= 3)
+  {
+    char * endptr = NULL;
+    opts.unit_size = strtol(argv[2], &endptr, 10);
+
+    if (*endptr != '\0' || __builtin_popcount(opts.unit_size) != 1)
+    {
+      print_usage(argv[0]);
+      exit(0);
+    }
+  }
+
+  if (argc == 4)
+  {
+    char * endptr = NULL;
+    opts.iters = strtol(argv[3], &endptr, 10);
+
+    if (*endptr != '\0')
+    {
+      print_usage(argv[0]);
+      exit(0);
+    }
+  }
+
+  printf("opts.mode      = %s\n", mode_names[opts.mode]);
+  printf("opts.unit_size = %zu\n", opts.unit_size);
+  printf("opts.iters     = %zu\n", opts.iters);
+
+  fflush(stdout);
+  return opts;
+}
@@ -0,0 +1,215 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "channels/blob.h"
+#include "channels/channel.h"
+
+#define UNIX_SOCK_PATH        "/tmp/ipc_unix_socket_blob_38315"
+#define BLOB_SOCK_PATH        "/tmp/ipc_blob_socket_ex_38316"
+#define DEFAULT_ITERS         100
+#define DEFAULT_SIZE_MB       1
+#define MB                    (1024 * 1024)
+
+typedef enum
+{
+  BLOB_MODE_SOCKET,
+  BLOB_MODE_MEMFD,
+  BLOB_MODE_MEMFD_SEALED,
+} blob_mode_t;
+
+static const char * mode_names[] = { "socket", "memfd", "memfd-sealed" };
+
+static void report_time(const char * label)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  printf("%s: %ld %09ld\n", label, ts.tv_sec, ts.tv_nsec);
+}
+
+struct blob_options
+{
+  size_t        size;
+  size_t        iters;
+  blob_mode_t   mode;
+};
+
+static void print_usage(const char * command)
+{
+  printf("USAGE: %s {socket|memfd|memfd-sealed} [size-mb] [iters]\n", command);
+  printf("\n");
+  printf(" - {socket|memfd|...} - how a blob gets to the receiver\n");
+  printf("                        socket:       copied through a unix socket channel\n");
+  printf("                        memfd:        pooled memfds passed with SCM_RIGHTS\n");
+  printf("                        memfd-sealed: a write-sealed memfd per blob\n");
+  printf(" - [size-mb]          - size of a blob in MB, 1 to 64, defaults to 1\n");
+  printf(" - [iters]            - number of blobs, defaults to 100\n");
+  printf("\n");
+  printf("   ex: %s memfd 16\n", command);
+}
+
+static struct blob_options demand_options(int argc, char ** argv);
+
+// the sender writes every blob, the receiver reads every blob
+static void fill(unsigned char * payload, size_t size, size_t iter)
+{
+  memset(payload, iter & 0xff, size);
+}
+
+static volatile unsigned long checksum;
+
+static void check(const unsigned char * payload, size_t size, size_t iter)
+{
+  unsigned long sum = 0;
+
+  for (size_t i = 0; i < size; i += sizeof(unsigned long))
+    sum += *(const unsigned long *) (payload + i);
+
+  checksum = sum;
+  assert(payload[0] == (iter & 0xff) && payload[size - 1] == (iter & 0xff));
+}
+
+static void run_socket(struct blob_options opts, bool sender)
+{
+  ipc_channel_api_t * ipc = ipc_channel_create(UNIX_SOCK_PATH, opts.size, IPC_CHANNEL_FLAVOR_SOCKET);
+  unsigned char * payload = malloc(opts.size);
+
+  assert(ipc != NULL && payload != NULL);
+
+  for (size_t i = 0; i < opts.iters; i++)
+  {
+    if (sender)
+    {
+      fill(payload, opts.size, i);
+      ipc->push(ipc, payload);
+    }
+    else
+    {
+      ipc->pop(ipc, payload);
+      check(payload, opts.size, i);
+    }
+  }
+
+  free(payload);
+  ipc->destroy(ipc);
+}
+
+static void run_memfd(struct blob_options opts, bool sender)
+{
+  ipc_blob_seal_t seal = opts.mode == BLOB_MODE_MEMFD_SEALED ? IPC_BLOB_SEAL_WRITE : IPC_BLOB_SEAL_NONE;
+  ipc_blob_channel_t * channel = ipc_blob_channel_create(BLOB_SOCK_PATH, seal);
+
+  assert(channel != NULL);
+
+  for (size_t i = 0; i < opts.iters; i++)
+  {
+    if (sender)
+    {
+      unsigned char * payload = ipc_blob_reserve(channel, opts.size);
+      assert(payload != NULL);
+
+      fill(payload, opts.size, i);
+      int ret = ipc_blob_submit(channel);
+      assert(ret == 0);
+    }
+    else
+    {
+      ipc_blob_t blob;
+      int ret = ipc_blob_recv(channel, &blob);
+      assert(ret == 0 && blob.size == opts.size);
+
+      check(blob.data, blob.size, i);
+      ipc_blob_release(channel, &blob);
+    }
+  }
+
+  ipc_blob_channel_destroy(channel);
+}
+
+int main(int argc, char ** argv)
+{
+  struct blob_options opts = demand_options(argc, argv);
+
+  remove(UNIX_SOCK_PATH);
+  remove(BLOB_SOCK_PATH);
+
+  void (* run)(struct blob_options, bool) =
+    opts.mode == BLOB_MODE_SOCKET ? run_socket : run_memfd;
+
+  if (!fork())
+  {
+    report_time("[BEGIN]");
+    run(opts, true);
+  }
+  else
+  {
+    run(opts, false);
+    report_time("[-END-]");
+    wait(&(int) {0});
+  }
+}
+
+static struct blob_options demand_options(int argc, char ** argv)
+{
+  struct blob_options opts =
+  {
+    .size  = DEFAULT_SIZE_MB * MB,
+    .iters = DEFAULT_ITERS,
+  };
+
+  if (argc == 1 || argc > 4)
+  {
+    print_usage(argv[0]);
+    exit(0);
+  }
+
+  if (!strcmp(argv[1], "socket"))
+    opts.mode = BLOB_MODE_SOCKET;
+  else if (!strcmp(argv[1], "memfd"))
+    opts.mode = BLOB_MODE_MEMFD;
+  else if (!strcmp(argv[1], "memfd-sealed"))
+    opts.mode = BLOB_MODE_MEMFD_SEALED;
+  else
+  {
+    print_usage(argv[0]);
+    exit(0);
+  }
+
+  if (argc >= 3)
+  {
+    char * endptr = NULL;
+    long size_mb = strtol(argv[2], &endptr, 10);
+
+    if (*endptr != '\0' || size_mb < 1 || size_mb > 64)
+    {
+      print_usage(argv[0]);
+      exit(0);
+    }
+
+    opts.size = size_mb * MB;
+  }
+
+  if (argc == 4)
+  {
+    char * endptr = NULL;
+    opts.iters = strtol(argv[3], &endptr, 10);
+
+    if (*endptr != '\0')
+    {
+      print_usage(argv[0]);
+      exit(0);
+    }
+  }
+
+  printf("opts.mode      = %s\n", mode_names[opts.mode]);
+  printf("opts.size      = %zu\n", opts.size);
+  printf("opts.iters     = %zu\n", opts.iters);
+
+  fflush(stdout);
+  return opts;
+}
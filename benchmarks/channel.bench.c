@@ -1,4 +1,6 @@
 #include <assert.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,9 +10,15 @@
 #include <unistd.h>
 
 #include "channels/channel.h"
+#include "channels/macros.h"
 
 #define MMAP_SHARED_MEM_NAME  "/ipc_shr_open_mmap_78324"
 #define UNIX_SOCK_PATH        "/tmp/ipc_unix_socket_ex_38310"
+#define URING_SOCK_PATH       "/tmp/ipc_uring_socket_ex_38312"
+#define JOURNAL_PATH          "/tmp/ipc_journal_ex_38313"
+#define TCP_ADDRESS           "127.0.0.1:38314"
+#define INPROC_NAME           "ipc_inproc_ex"
+#define SOCKET_CREDITS        1024
 #define DEFAULT_ITERS         1000000
 #define DEFAULT_UNIT_SIZE     8
 
@@ -26,20 +34,27 @@ static void report_time(const char * label)
 struct channel_options
 {
   const char            * name;
+  const char            * label;
   size_t                  unit_size;
   size_t                  iters;
   ipc_channel_flavors_t   flavor;
+  ipc_channel_options_t   tuning;
 };
 
 static void print_usage(const char * command)
 {
-  printf("USAGE: %s {mmap|socket} [unit-size] [iters]\n", command);
+  printf("USAGE: %s {mmap|socket|uring|uring-sqpoll|journal|journal-sync|tcp|tcp-busy-poll|inproc|socket-credits} [unit-size] [iters]\n", command);
   printf("\n");
-  printf(" - {mmap|socket} - channel flavor\n");
-  printf(" - [unit-size]   - size of a message transmitted over channel\n");
-  printf("                   MUST be a power of 2, defaults to 8");
-  printf(" - [iters]       - number of transmissions over channel\n");
-  printf("                   defaults to 1000000\n");
+  printf(" - {mmap|socket|...} - channel flavor\n");
+  printf("                       uring-sqpoll: uring with a kernel polling thread\n");
+  printf("                       journal-sync: journal with a group commit\n");
+  printf("                       tcp-busy-poll: tcp with 50us of SO_BUSY_POLL\n");
+  printf("                       inproc: threads of one process\n");
+  printf("                       socket-credits: socket with 1024 units of credit\n");
+  printf(" - [unit-size]       - size of a message transmitted over channel\n");
+  printf("                       MUST be a power of 2, defaults to 8\n");
+  printf(" - [iters]           - number of transmissions over channel\n");
+  printf("                       defaults to 1000000\n");
   printf("\n");
   printf("   ex: %s mmap 32\n", command);
 }
@@ -47,54 +62,99 @@ static void print_usage(const char * command)
 static struct channel_options demand_options(int argc, char ** argv);
 static void clear_old_medium(struct channel_options opts);
 
+static void produce(const struct channel_options * opts)
+{
+  unsigned char * unit = malloc(opts->unit_size);
+  ipc_channel_api_t * ipc = ipc_channel_create_with(opts->name,
+                                                    opts->unit_size,
+                                                    opts->flavor,
+                                                    &opts->tuning);
+
+  assert(ipc != NULL);
+  
+  report_time("[BEGIN]");
+
+  for (int i = 0; i < opts->iters; i++)
+  {
+    unit[0] = i & 0xff;
+
+    int err = ipc->push(ipc, unit);
+    if (err)
+    {
+      printf("push: %s\n", strerror(err));
+      exit(1);
+    }
+  }
+
+  ipc_channel_gauges_t gauges;
+  if (ipc_channel_gauges(ipc, &gauges) == 0)
+    printf("producer stalls = %" PRIu64 "\n", gauges.stalls);
+
+  free(unit);
+  ipc->destroy(ipc);
+}
+
+static void * produce_thread(void * opts)
+{
+  produce(opts);
+  return NULL;
+}
+
+static void consume(const struct channel_options * opts, ipc_channel_api_t * ipc)
+{
+  unsigned char * unit = malloc(opts->unit_size);
+
+  for (int i = 0; i < opts->iters; i++)
+  {
+    ipc->pop(ipc, unit);
+    if (unit[0] != (i & 0xff))
+    {
+      printf("%d != %d\n", unit[0], i & 0xff);
+    }
+    assert(unit[0] == (i & 0xff));
+  }
+
+  free(unit);
+  report_time("[-END-]");
+}
+
 int main(int argc, char ** argv)
 {
   struct channel_options opts = demand_options(argc, argv);
   clear_old_medium(opts);
 
-  if (!fork())
+  if (opts.flavor == IPC_CHANNEL_FLAVOR_INPROC)
   {
-    unsigned char * unit = malloc(opts.unit_size);
-    ipc_channel_api_t * ipc = ipc_channel_create(opts.name,
-                                                 opts.unit_size,
-                                                 opts.flavor);
+    // the consumer holds the ring before the producer thread comes
+    // and goes, the ring lives while a channel holds it
+    pthread_t producer;
+    ipc_channel_api_t * ipc = ipc_channel_create_with(opts.name,
+                                                      opts.unit_size,
+                                                      opts.flavor,
+                                                      &opts.tuning);
 
     assert(ipc != NULL);
-    
-    report_time("[BEGIN]");
+    IPC_EOK(pthread_create(&producer, NULL, produce_thread, &opts));
 
-    for (int i = 0; i < opts.iters; i++)
-    {
-      unit[0] = i & 0xff;
-      ipc->push(ipc, unit);
-    }
+    consume(&opts, ipc);
 
-    free(unit);
+    IPC_EOK(pthread_join(producer, NULL));
     ipc->destroy(ipc);
   }
+  else if (!fork())
+  {
+    produce(&opts);
+  }
   else
   {
-    unsigned char * unit = malloc(opts.unit_size);
-    ipc_channel_api_t * ipc = ipc_channel_create(opts.name,
-                                                 opts.unit_size,
-                                                 opts.flavor);
+    ipc_channel_api_t * ipc = ipc_channel_create_with(opts.name,
+                                                      opts.unit_size,
+                                                      opts.flavor,
+                                                      &opts.tuning);
 
     assert(ipc != NULL);
 
-    double received;
-
-    for (int i = 0; i < opts.iters; i++)
-    {
-      ipc->pop(ipc, unit);
-      if (unit[0] != (i & 0xff))
-      {
-        printf("%d != %d\n", unit[0], i & 0xff);
-      }
-      assert(unit[0] == (i & 0xff));
-    }
-
-    free(unit);
-    report_time("[-END-]");
+    consume(&opts, ipc);
     wait(&(int) {0});
     ipc->destroy(ipc);
   }
@@ -104,6 +164,7 @@ static struct channel_options demand_options(int argc, char ** argv)
 {
   struct channel_options opts =
   {
+    .label     = argc >= 2 ? argv[1] : "",
     .unit_size = DEFAULT_UNIT_SIZE,
     .iters     = DEFAULT_ITERS,
   };
@@ -126,6 +187,50 @@ static struct channel_options demand_options(int argc, char ** argv)
       opts.flavor = IPC_CHANNEL_FLAVOR_SOCKET;
       opts.name   = UNIX_SOCK_PATH;
     }
+    else if (!strcmp(argv[1], "socket-credits"))
+    {
+      opts.flavor = IPC_CHANNEL_FLAVOR_SOCKET;
+      opts.name   = UNIX_SOCK_PATH;
+      opts.tuning.socket.credits = SOCKET_CREDITS;
+    }
+    else if (!strcmp(argv[1], "uring"))
+    {
+      opts.flavor = IPC_CHANNEL_FLAVOR_URING;
+      opts.name   = URING_SOCK_PATH;
+    }
+    else if (!strcmp(argv[1], "uring-sqpoll"))
+    {
+      opts.flavor = IPC_CHANNEL_FLAVOR_URING;
+      opts.name   = URING_SOCK_PATH;
+      opts.tuning.uring.sqpoll = true;
+    }
+    else if (!strcmp(argv[1], "journal"))
+    {
+      opts.flavor = IPC_CHANNEL_FLAVOR_JOURNAL;
+      opts.name   = JOURNAL_PATH;
+    }
+    else if (!strcmp(argv[1], "journal-sync"))
+    {
+      opts.flavor = IPC_CHANNEL_FLAVOR_JOURNAL;
+      opts.name   = JOURNAL_PATH;
+      opts.tuning.journal.sync = IPC_JOURNAL_SYNC_MSYNC;
+    }
+    else if (!strcmp(argv[1], "tcp"))
+    {
+      opts.flavor = IPC_CHANNEL_FLAVOR_TCP;
+      opts.name   = TCP_ADDRESS;
+    }
+    else if (!strcmp(argv[1], "tcp-busy-poll"))
+    {
+      opts.flavor = IPC_CHANNEL_FLAVOR_TCP;
+      opts.name   = TCP_ADDRESS;
+      opts.tuning.tcp.busy_poll = 50;
+    }
+    else if (!strcmp(argv[1], "inproc"))
+    {
+      opts.flavor = IPC_CHANNEL_FLAVOR_INPROC;
+      opts.name   = INPROC_NAME;
+    }
     else
     {
       print_usage(argv[0]);
@@ -157,8 +262,10 @@ static struct channel_options demand_options(int argc, char ** argv)
     }
   }
 
-  printf("opts.flavor    = %s\n",
-         opts.flavor == IPC_CHANNEL_FLAVOR_MMAP ? "mmap" : "socket");
+  // the journal is append-only, it has to hold the whole run
+  opts.tuning.journal.capacity = opts.iters * opts.unit_size;
+
+  printf("opts.flavor    = %s\n", opts.label);
 
   printf("opts.unit_size = %zu\n", opts.unit_size);
   printf("opts.iters     = %zu\n", opts.iters);
@@ -179,7 +286,13 @@ static void clear_old_medium(struct channel_options opts)
       break;
 
     case IPC_CHANNEL_FLAVOR_SOCKET:
+    case IPC_CHANNEL_FLAVOR_URING:
+    case IPC_CHANNEL_FLAVOR_JOURNAL:
       remove(opts.name);
       break;
+
+    case IPC_CHANNEL_FLAVOR_TCP:
+    case IPC_CHANNEL_FLAVOR_INPROC:
+      break;
   }
 }
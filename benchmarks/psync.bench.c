@@ -0,0 +1,683 @@
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "channels/psync/cv.h"
+#include "channels/psync/futex.h"
+#include "channels/psync/mutex.h"
+
+#define DEFAULT_ITERS         100000
+#define SPINS_BEFORE_YIELD    128
+#define WAKE_SETTLE_NS        (20 * 1000)
+
+typedef enum
+{
+  PSYNC_MODE_LOCK,       // lock/unlock latency, both processes contend
+  PSYNC_MODE_WAKE,       // a sleeping waiter's latency from the signal to running
+  PSYNC_MODE_PINGPONG,   // a round trip of a turn between the processes
+} psync_mode_t;
+
+static const char * mode_names[] = { "lock", "wake", "pingpong" };
+
+struct psync_options
+{
+  psync_mode_t   mode;
+  size_t         iters;
+  int            cpus[2];
+};
+
+// Everything both processes touch lives in one shared anonymous mapping,
+// `pmutex`/`pcond` are the process-shared pthread pair `ipc_cv_t` replaced
+typedef struct
+{
+  ipc_mutex_t      mutex;
+  ipc_cv_t         cv;
+  pthread_mutex_t  pmutex;
+  pthread_cond_t   pcond;
+
+  atomic_uint    word;          // futex lock word, or the turn
+  atomic_uint    ticket_next;
+  atomic_uint    ticket_serving;
+  atomic_uint    ready;
+  atomic_ullong  stamp;
+  unsigned       turn;
+  size_t         counter;
+
+  int            eventfds[2];
+  int            pipes[2][2];
+} psync_shared_t;
+
+typedef struct
+{
+  const char * name;
+  // side 0 is the parent, side 1 the child, `samples` is the side's own
+  void (* run)(psync_shared_t * shared, int side, uint64_t * samples, size_t iters);
+} psync_primitive_t;
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Busy waiting yields now and then, the peer may share the core
+static void relax(unsigned * spins)
+{
+  if (++*spins % SPINS_BEFORE_YIELD == 0)
+    sched_yield();
+}
+
+static void pin(int cpu)
+{
+  if (cpu < 0)
+    return;
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+
+  if (sched_setaffinity(0, sizeof(set), &set))
+    perror("sched_setaffinity");
+}
+
+//****************//
+//      locks     //
+//****************//
+
+// 0: unlocked, 1: locked, 2: locked with sleepers
+static void futex_lock(atomic_uint * word)
+{
+  unsigned expected = 0;
+
+  if (atomic_compare_exchange_strong(word, &expected, 1))
+    return;
+
+  if (expected != 2)
+    expected = atomic_exchange(word, 2);
+
+  while (expected != 0)
+  {
+    ipc_futex_wait(word, 2, NULL);
+    expected = atomic_exchange(word, 2);
+  }
+}
+
+static void futex_unlock(atomic_uint * word)
+{
+  if (atomic_exchange(word, 0) == 2)
+    ipc_futex_wake(word, 1);
+}
+
+static void spin_lock(atomic_uint * word)
+{
+  unsigned spins = 0;
+
+  while (atomic_exchange_explicit(word, 1, memory_order_acquire))
+    while (atomic_load_explicit(word, memory_order_relaxed))
+      relax(&spins);
+}
+
+static void spin_unlock(atomic_uint * word)
+{
+  atomic_store_explicit(word, 0, memory_order_release);
+}
+
+static void ticket_lock(psync_shared_t * shared)
+{
+  unsigned ticket = atomic_fetch_add(&shared->ticket_next, 1);
+  unsigned spins = 0;
+
+  while (atomic_load_explicit(&shared->ticket_serving, memory_order_acquire) != ticket)
+    relax(&spins);
+}
+
+static void ticket_unlock(psync_shared_t * shared)
+{
+  atomic_fetch_add_explicit(&shared->ticket_serving, 1, memory_order_release);
+}
+
+#define LOCK_LOOP(lock_, unlock_)            \
+  for (size_t i = 0; i < iters; i++)         \
+  {                                          \
+    uint64_t begin = now_ns();               \
+    lock_;                                   \
+    shared->counter++;                       \
+    unlock_;                                 \
+    samples[i] = now_ns() - begin;           \
+  }
+
+static void lock_mutex(psync_shared_t * shared, int side, uint64_t * samples, size_t iters)
+{
+  LOCK_LOOP(ipc_mutex_lock(&shared->mutex), ipc_mutex_unlock(&shared->mutex));
+}
+
+static void lock_futex(psync_shared_t * shared, int side, uint64_t * samples, size_t iters)
+{
+  LOCK_LOOP(futex_lock(&shared->word), futex_unlock(&shared->word));
+}
+
+static void lock_spin(psync_shared_t * shared, int side, uint64_t * samples, size_t iters)
+{
+  LOCK_LOOP(spin_lock(&shared->word), spin_unlock(&shared->word));
+}
+
+static void lock_ticket(psync_shared_t * shared, int side, uint64_t * samples, size_t iters)
+{
+  LOCK_LOOP(ticket_lock(shared), ticket_unlock(shared));
+}
+
+//****************//
+//     wakeups    //
+//****************//
+
+// The waiter says it is about to sleep, the waker lets it fall asleep,
+// stamps the time and signals, the waiter takes the difference
+static void announce(psync_shared_t * shared)
+{
+  atomic_store(&shared->ready, 1);
+}
+
+static void await_sleeper(psync_shared_t * shared)
+{
+  unsigned spins = 0;
+
+  while (!atomic_load(&shared->ready))
+    relax(&spins);
+
+  atomic_store(&shared->ready, 0);
+  nanosleep(&(struct timespec) { .tv_nsec = WAKE_SETTLE_NS }, NULL);
+  atomic_store(&shared->stamp, now_ns());
+}
+
+static uint64_t since_stamp(psync_shared_t * shared)
+{
+  return now_ns() - atomic_load(&shared->stamp);
+}
+
+static void wake_cv(psync_shared_t * shared, int side, uint64_t * samples, size_t iters)
+{
+  for (size_t i = 0; i < iters; i++)
+  {
+    if (side == 0)
+    {
+      IPC_CRITICAL_SECTION(&shared->mutex)
+      {
+        announce(shared);
+        while (shared->turn == i)
+          ipc_cv_wait(&shared->cv, &shared->mutex);
+      }
+      samples[i] = since_stamp(shared);
+    }
+    else
+    {
+      await_sleeper(shared);
+      IPC_CRITICAL_SECTION(&shared->mutex)
+      {
+        shared->turn = i + 1;
+        ipc_cv_notify_one(&shared->cv);
+      }
+    }
+  }
+}
+
+static void wake_pcond(psync_shared_t * shared, int side, uint64_t * samples, size_t iters)
+{
+  for (size_t i = 0; i < iters; i++)
+  {
+    if (side == 0)
+    {
+      pthread_mutex_lock(&shared->pmutex);
+      announce(shared);
+      while (shared->turn == i)
+        pthread_cond_wait(&shared->pcond, &shared->pmutex);
+      pthread_mutex_unlock(&shared->pmutex);
+      samples[i] = since_stamp(shared);
+    }
+    else
+    {
+      await_sleeper(shared);
+      pthread_mutex_lock(&shared->pmutex);
+      shared->turn = i + 1;
+      pthread_cond_signal(&shared->pcond);
+      pthread_mutex_unlock(&shared->pmutex);
+    }
+  }
+}
+
+static void wake_futex(psync_shared_t * shared, int side, uint64_t * samples, size_t iters)
+{
+  for (size_t i = 0; i < iters; i++)
+  {
+    if (side == 0)
+    {
+      announce(shared);
+      while (atomic_load(&shared->word) == i)
+        ipc_futex_wait(&shared->word, i, NULL);
+      samples[i] = since_stamp(shared);
+    }
+    else
+    {
+      await_sleeper(shared);
+      atomic_store(&shared->word, i + 1);
+      ipc_futex_wake(&shared->word, 1);
+    }
+  }
+}
+
+static void wake_eventfd(psync_shared_t * shared, int side, uint64_t * samples, size_t iters)
+{
+  uint64_t value = 1;
+
+  for (size_t i = 0; i < iters; i++)
+  {
+    if (side == 0)
+    {
+      announce(shared);
+      ssize_t ret = read(shared->eventfds[0], &value, sizeof(value));
+      assert(ret == sizeof(value));
+      samples[i] = since_stamp(shared);
+    }
+    else
+    {
+      await_sleeper(shared);
+      ssize_t ret = write(shared->eventfds[0], &value, sizeof(value));
+      assert(ret == sizeof(value));
+    }
+  }
+}
+
+static void wake_pipe(psync_shared_t * shared, int side, uint64_t * samples, size_t iters)
+{
+  char byte = 0;
+
+  for (size_t i = 0; i < iters; i++)
+  {
+    if (side == 0)
+    {
+      announce(shared);
+      ssize_t ret = read(shared->pipes[0][0], &byte, 1);
+      assert(ret == 1);
+      samples[i] = since_stamp(shared);
+    }
+    else
+    {
+      await_sleeper(shared);
+      ssize_t ret = write(shared->pipes[0][1], &byte, 1);
+      assert(ret == 1);
+    }
+  }
+}
+
+//****************//
+//    ping-pong   //
+//****************//
+
+// The turn goes 0 -> 1 -> 0, side 0 samples the round trip
+#define PINGPONG_LOOP(pass_, await_)                   \
+  for (size_t i = 0; i < iters; i++)                   \
+  {                                                    \
+    if (side == 0)                                     \
+    {                                                  \
+      uint64_t begin = now_ns();                       \
+      pass_(shared, 1);                                \
+      await_(shared, 0);                               \
+      samples[i] = now_ns() - begin;                   \
+    }                                                  \
+    else                                               \
+    {                                                  \
+      await_(shared, 1);                               \
+      pass_(shared, 0);                                \
+    }                                                  \
+  }
+
+static void cv_pass(psync_shared_t * shared, unsigned to)
+{
+  IPC_CRITICAL_SECTION(&shared->mutex)
+  {
+    shared->turn = to;
+    ipc_cv_notify_one(&shared->cv);
+  }
+}
+
+static void cv_await(psync_shared_t * shared, unsigned mine)
+{
+  IPC_CRITICAL_SECTION(&shared->mutex)
+  {
+    while (shared->turn != mine)
+      ipc_cv_wait(&shared->cv, &shared->mutex);
+  }
+}
+
+static void pcond_pass(psync_shared_t * shared, unsigned to)
+{
+  pthread_mutex_lock(&shared->pmutex);
+  shared->turn = to;
+  pthread_cond_signal(&shared->pcond);
+  pthread_mutex_unlock(&shared->pmutex);
+}
+
+static void pcond_await(psync_shared_t * shared, unsigned mine)
+{
+  pthread_mutex_lock(&shared->pmutex);
+  while (shared->turn != mine)
+    pthread_cond_wait(&shared->pcond, &shared->pmutex);
+  pthread_mutex_unlock(&shared->pmutex);
+}
+
+static void futex_pass(psync_shared_t * shared, unsigned to)
+{
+  atomic_store(&shared->word, to);
+  ipc_futex_wake(&shared->word, 1);
+}
+
+static void futex_await(psync_shared_t * shared, unsigned mine)
+{
+  unsigned turn;
+
+  while ((turn = atomic_load(&shared->word)) != mine)
+    ipc_futex_wait(&shared->word, turn, NULL);
+}
+
+static void spin_pass(psync_shared_t * shared, unsigned to)
+{
+  atomic_store_explicit(&shared->word, to, memory_order_release);
+}
+
+static void spin_await(psync_shared_t * shared, unsigned mine)
+{
+  unsigned spins = 0;
+
+  while (atomic_load_explicit(&shared->word, memory_order_acquire) != mine)
+    relax(&spins);
+}
+
+static void eventfd_pass(psync_shared_t * shared, unsigned to)
+{
+  uint64_t value = 1;
+  ssize_t ret = write(shared->eventfds[to], &value, sizeof(value));
+  assert(ret == sizeof(value));
+}
+
+static void eventfd_await(psync_shared_t * shared, unsigned mine)
+{
+  uint64_t value;
+  ssize_t ret = read(shared->eventfds[mine], &value, sizeof(value));
+  assert(ret == sizeof(value));
+}
+
+static void pipe_pass(psync_shared_t * shared, unsigned to)
+{
+  ssize_t ret = write(shared->pipes[to][1], "", 1);
+  assert(ret == 1);
+}
+
+static void pipe_await(psync_shared_t * shared, unsigned mine)
+{
+  char byte;
+  ssize_t ret = read(shared->pipes[mine][0], &byte, 1);
+  assert(ret == 1);
+}
+
+static void pingpong_cv(psync_shared_t * shared, int side, uint64_t * samples, size_t iters)
+{
+  PINGPONG_LOOP(cv_pass, cv_await);
+}
+
+static void pingpong_pcond(psync_shared_t * shared, int side, uint64_t * samples, size_t iters)
+{
+  PINGPONG_LOOP(pcond_pass, pcond_await);
+}
+
+static void pingpong_futex(psync_shared_t * shared, int side, uint64_t * samples, size_t iters)
+{
+  PINGPONG_LOOP(futex_pass, futex_await);
+}
+
+static void pingpong_spin(psync_shared_t * shared, int side, uint64_t * samples, size_t iters)
+{
+  PINGPONG_LOOP(spin_pass, spin_await);
+}
+
+static void pingpong_eventfd(psync_shared_t * shared, int side, uint64_t * samples, size_t iters)
+{
+  PINGPONG_LOOP(eventfd_pass, eventfd_await);
+}
+
+static void pingpong_pipe(psync_shared_t * shared, int side, uint64_t * samples, size_t iters)
+{
+  PINGPONG_LOOP(pipe_pass, pipe_await);
+}
+
+static const psync_primitive_t lock_primitives[] =
+{
+  { "mutex",   lock_mutex  },
+  { "futex",   lock_futex  },
+  { "spin",    lock_spin   },
+  { "ticket",  lock_ticket },
+  { NULL },
+};
+
+static const psync_primitive_t wake_primitives[] =
+{
+  { "cv",      wake_cv      },
+  { "pcond",   wake_pcond   },
+  { "futex",   wake_futex   },
+  { "eventfd", wake_eventfd },
+  { "pipe",    wake_pipe    },
+  { NULL },
+};
+
+static const psync_primitive_t pingpong_primitives[] =
+{
+  { "cv",      pingpong_cv      },
+  { "pcond",   pingpong_pcond   },
+  { "futex",   pingpong_futex   },
+  { "spin",    pingpong_spin    },
+  { "eventfd", pingpong_eventfd },
+  { "pipe",    pingpong_pipe    },
+  { NULL },
+};
+
+static const psync_primitive_t * primitives[] =
+{
+  [PSYNC_MODE_LOCK]     = lock_primitives,
+  [PSYNC_MODE_WAKE]     = wake_primitives,
+  [PSYNC_MODE_PINGPONG] = pingpong_primitives,
+};
+
+static void shared_init(psync_shared_t * shared)
+{
+  memset(shared, 0, sizeof(*shared));
+
+  IPC_EOK(ipc_mutex_init(&shared->mutex));
+  IPC_EOK(ipc_cv_init(&shared->cv));
+
+  pthread_mutexattr_t mutex_attr;
+  pthread_condattr_t cond_attr;
+
+  IPC_EOK(pthread_mutexattr_init(&mutex_attr));
+  IPC_EOK(pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED));
+  IPC_EOK(pthread_mutex_init(&shared->pmutex, &mutex_attr));
+  pthread_mutexattr_destroy(&mutex_attr);
+
+  IPC_EOK(pthread_condattr_init(&cond_attr));
+  IPC_EOK(pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED));
+  IPC_EOK(pthread_cond_init(&shared->pcond, &cond_attr));
+  pthread_condattr_destroy(&cond_attr);
+
+  for (int i = 0; i < 2; i++)
+  {
+    shared->eventfds[i] = eventfd(0, 0);
+    assert(shared->eventfds[i] != -1);
+    IPC_EOK(pipe(shared->pipes[i]) ? errno : 0);
+  }
+}
+
+static void shared_fini(psync_shared_t * shared)
+{
+  ipc_mutex_destroy(&shared->mutex);
+  ipc_cv_destroy(&shared->cv);
+  pthread_mutex_destroy(&shared->pmutex);
+  pthread_cond_destroy(&shared->pcond);
+
+  for (int i = 0; i < 2; i++)
+  {
+    close(shared->eventfds[i]);
+    close(shared->pipes[i][0]);
+    close(shared->pipes[i][1]);
+  }
+}
+
+static int compare_samples(const void * a, const void * b)
+{
+  uint64_t lhs = *(const uint64_t *) a, rhs = *(const uint64_t *) b;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+static void report(const char * name, uint64_t * samples, size_t count)
+{
+  qsort(samples, count, sizeof(uint64_t), compare_samples);
+
+#define PERCENTILE(p_) samples[(size_t) ((count - 1) * (p_))]
+  printf("[%-7s] p50: %8lu ns  p90: %8lu ns  p99: %8lu ns  p99.9: %8lu ns  max: %8lu ns\n",
+         name,
+         PERCENTILE(0.5), PERCENTILE(0.9), PERCENTILE(0.99), PERCENTILE(0.999),
+         samples[count - 1]);
+#undef PERCENTILE
+
+  fflush(stdout);
+}
+
+static void print_usage(const char * command)
+{
+  printf("USAGE: %s {lock|wake|pingpong} [iters] [cpu-a] [cpu-b]\n", command);
+  printf("\n");
+  printf(" - {lock|wake|pingpong} - what is measured between two processes\n");
+  printf("                          lock:     lock/unlock latency under contention\n");
+  printf("                          wake:     latency from a signal to the sleeper running\n");
+  printf("                          pingpong: round trip of a turn\n");
+  printf(" - [iters]              - samples per process, defaults to 100000\n");
+  printf(" - [cpu-a] [cpu-b]      - cores the processes are pinned to,\n");
+  printf("                          -1 (default) leaves a process unpinned\n");
+  printf("\n");
+  printf("   ex: %s pingpong 100000 0 1\n", command);
+}
+
+static struct psync_options demand_options(int argc, char ** argv);
+
+int main(int argc, char ** argv)
+{
+  struct psync_options opts = demand_options(argc, argv);
+
+  psync_shared_t * shared = mmap(NULL, sizeof(psync_shared_t), PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  uint64_t * samples = mmap(NULL, 2 * opts.iters * sizeof(uint64_t), PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+  assert(shared != MAP_FAILED && samples != MAP_FAILED);
+
+  pin(opts.cpus[0]);
+
+  for (const psync_primitive_t * primitive = primitives[opts.mode]; primitive->name; primitive++)
+  {
+    shared_init(shared);
+
+    if (!fork())
+    {
+      pin(opts.cpus[1]);
+      primitive->run(shared, 1, samples + opts.iters, opts.iters);
+      exit(0);
+    }
+
+    primitive->run(shared, 0, samples, opts.iters);
+    wait(&(int) {0});
+
+    if (opts.mode == PSYNC_MODE_LOCK)
+    {
+      assert(shared->counter == 2 * opts.iters);
+      report(primitive->name, samples, 2 * opts.iters);
+    }
+    else
+    {
+      report(primitive->name, samples, opts.iters);
+    }
+
+    shared_fini(shared);
+  }
+
+  munmap(samples, 2 * opts.iters * sizeof(uint64_t));
+  munmap(shared, sizeof(psync_shared_t));
+}
+
+static struct psync_options demand_options(int argc, char ** argv)
+{
+  struct psync_options opts =
+  {
+    .iters = DEFAULT_ITERS,
+    .cpus  = { -1, -1 },
+  };
+
+  if (argc == 1 || argc > 5)
+  {
+    print_usage(argv[0]);
+    exit(0);
+  }
+
+  if (!strcmp(argv[1], "lock"))
+    opts.mode = PSYNC_MODE_LOCK;
+  else if (!strcmp(argv[1], "wake"))
+    opts.mode = PSYNC_MODE_WAKE;
+  else if (!strcmp(argv[1], "pingpong"))
+    opts.mode = PSYNC_MODE_PINGPONG;
+  else
+  {
+    print_usage(argv[0]);
+    exit(0);
+  }
+
+  if (argc >= 3)
+  {
+    char * endptr = NULL;
+    opts.iters = strtol(argv[2], &endptr, 10);
+
+    if (*endptr != '\0' || opts.iters == 0)
+    {
+      print_usage(argv[0]);
+      exit(0);
+    }
+  }
+
+  for (int i = 0; i < 2 && argc >= 4 + i; i++)
+  {
+    char * endptr = NULL;
+    opts.cpus[i] = strtol(argv[3 + i], &endptr, 10);
+
+    if (*endptr != '\0')
+    {
+      print_usage(argv[0]);
+      exit(0);
+    }
+  }
+
+  printf("opts.mode      = %s\n", mode_names[opts.mode]);
+  printf("opts.iters     = %zu\n", opts.iters);
+  printf("opts.cpus      = %d %d\n", opts.cpus[0], opts.cpus[1]);
+
+  fflush(stdout);
+  return opts;
+}
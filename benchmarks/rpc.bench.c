@@ -0,0 +1,266 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "channels/channel.h"
+#include "channels/duplex.h"
+
+#define MMAP_REQUEST_MEM_NAME "/ipc_shr_open_mmap_rpc_req_78325"
+#define MMAP_REPLY_MEM_NAME   "/ipc_shr_open_mmap_rpc_rep_78326"
+#define DUPLEX_MEM_NAME       "/ipc_shr_open_duplex_78327"
+#define UNIX_SOCK_PATH        "/tmp/ipc_unix_socket_rpc_38311"
+#define DEFAULT_ITERS         100000
+#define DEFAULT_UNIT_SIZE     8
+
+typedef enum
+{
+  RPC_MODE_MMAP,
+  RPC_MODE_SOCKET,
+  RPC_MODE_DUPLEX,
+} rpc_mode_t;
+
+static const char * mode_names[] = { "mmap", "socket", "duplex" };
+
+static void report_time(const char * label)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  printf("%s: %ld %09ld\n", label, ts.tv_sec, ts.tv_nsec);
+}
+
+struct rpc_options
+{
+  size_t       unit_size;
+  size_t       iters;
+  rpc_mode_t   mode;
+};
+
+// Both peers see the request/reply path through the same three calls,
+// whatever the underlying transport is.
+typedef struct
+{
+  rpc_mode_t            mode;
+  ipc_channel_api_t   * requests;
+  ipc_channel_api_t   * replies;
+  ipc_duplex_t        * duplex;
+} rpc_endpoint_t;
+
+static void print_usage(const char * command)
+{
+  printf("USAGE: %s {mmap|socket|duplex} [unit-size] [iters]\n", command);
+  printf("\n");
+  printf(" - {mmap|socket|duplex} - transport of the request/reply pair\n");
+  printf("                          mmap:   two mmap channels\n");
+  printf("                          socket: one unix socket channel\n");
+  printf("                          duplex: one duplex segment\n");
+  printf(" - [unit-size]          - size of a request and a reply\n");
+  printf("                          MUST be a power of 2, defaults to 8\n");
+  printf(" - [iters]              - number of round trips\n");
+  printf("                          defaults to 100000\n");
+  printf("\n");
+  printf("   ex: %s duplex 64\n", command);
+}
+
+static struct rpc_options demand_options(int argc, char ** argv);
+static void clear_old_medium(struct rpc_options opts);
+
+static rpc_endpoint_t endpoint_open(rpc_mode_t mode, size_t unit_size, ipc_duplex_side_t side)
+{
+  rpc_endpoint_t ep = { .mode = mode };
+
+  switch (mode)
+  {
+    case RPC_MODE_MMAP:
+      ep.requests = ipc_channel_create(MMAP_REQUEST_MEM_NAME, unit_size, IPC_CHANNEL_FLAVOR_MMAP);
+      ep.replies  = ipc_channel_create(MMAP_REPLY_MEM_NAME, unit_size, IPC_CHANNEL_FLAVOR_MMAP);
+      assert(ep.requests && ep.replies);
+      break;
+
+    case RPC_MODE_SOCKET:
+      // a stream socket is bidirectional already
+      ep.requests = ipc_channel_create(UNIX_SOCK_PATH, unit_size, IPC_CHANNEL_FLAVOR_SOCKET);
+      ep.replies  = ep.requests;
+      assert(ep.requests);
+      break;
+
+    case RPC_MODE_DUPLEX:
+      ep.duplex = ipc_duplex_create(DUPLEX_MEM_NAME, unit_size, side);
+      assert(ep.duplex);
+      break;
+  }
+
+  return ep;
+}
+
+static void endpoint_close(rpc_endpoint_t * ep)
+{
+  if (ep->mode == RPC_MODE_DUPLEX)
+  {
+    ipc_duplex_destroy(ep->duplex);
+    return;
+  }
+
+  if (ep->replies != ep->requests)
+    ep->replies->destroy(ep->replies);
+
+  ep->requests->destroy(ep->requests);
+}
+
+static void endpoint_call(rpc_endpoint_t * ep, const void * request, void * reply)
+{
+  if (ep->mode == RPC_MODE_DUPLEX)
+  {
+    ipc_duplex_call(ep->duplex, request, reply);
+    return;
+  }
+
+  ep->requests->push(ep->requests, request);
+  ep->replies->pop(ep->replies, reply);
+}
+
+static void endpoint_serve(rpc_endpoint_t * ep, void * unit)
+{
+  if (ep->mode == RPC_MODE_DUPLEX)
+  {
+    ipc_corr_id_t id = ipc_duplex_recv(ep->duplex, unit);
+    ipc_duplex_reply(ep->duplex, id, unit);
+    return;
+  }
+
+  ep->requests->pop(ep->requests, unit);
+  ep->replies->push(ep->replies, unit);
+}
+
+int main(int argc, char ** argv)
+{
+  struct rpc_options opts = demand_options(argc, argv);
+  clear_old_medium(opts);
+
+  if (!fork())
+  {
+    // server: echoes every request back as the reply
+    unsigned char * unit = malloc(opts.unit_size);
+    rpc_endpoint_t ep = endpoint_open(opts.mode, opts.unit_size, IPC_DUPLEX_SERVER);
+
+    for (size_t i = 0; i < opts.iters; i++)
+    {
+      endpoint_serve(&ep, unit);
+    }
+
+    free(unit);
+    endpoint_close(&ep);
+  }
+  else
+  {
+    unsigned char * request = calloc(1, opts.unit_size);
+    unsigned char * reply = malloc(opts.unit_size);
+    rpc_endpoint_t ep = endpoint_open(opts.mode, opts.unit_size, IPC_DUPLEX_CLIENT);
+    struct timespec begin, end;
+
+    report_time("[BEGIN]");
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+
+    for (size_t i = 0; i < opts.iters; i++)
+    {
+      request[0] = i & 0xff;
+      endpoint_call(&ep, request, reply);
+      assert(reply[0] == (i & 0xff));
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    report_time("[-END-]");
+
+    double ns = (end.tv_sec - begin.tv_sec) * 1e9 + (end.tv_nsec - begin.tv_nsec);
+    printf("[RTT]: %.1f ns\n", ns / opts.iters);
+
+    free(request);
+    free(reply);
+    wait(&(int) {0});
+    endpoint_close(&ep);
+  }
+}
+
+static struct rpc_options demand_options(int argc, char ** argv)
+{
+  struct rpc_options opts =
+  {
+    .unit_size = DEFAULT_UNIT_SIZE,
+    .iters     = DEFAULT_ITERS,
+  };
+
+  if (argc == 1 || argc > 4)
+  {
+    print_usage(argv[0]);
+    exit(0);
+  }
+
+  if (argc >= 2)
+  {
+    if (!strcmp(argv[1], "mmap"))
+      opts.mode = RPC_MODE_MMAP;
+    else if (!strcmp(argv[1], "socket"))
+      opts.mode = RPC_MODE_SOCKET;
+    else if (!strcmp(argv[1], "duplex"))
+      opts.mode = RPC_MODE_DUPLEX;
+    else
+    {
+      print_usage(argv[0]);
+      exit(0);
+    }
+  }
+
+  if (argc >= 3)
+  {
+    char * endptr = NULL;
+    opts.unit_size = strtol(argv[2], &endptr, 10);
+
+    if (*endptr != '\0' || __builtin_popcount(opts.unit_size) != 1)
+    {
+      print_usage(argv[0]);
+      exit(0);
+    }
+  }
+
+  if (argc == 4)
+  {
+    char * endptr = NULL;
+    opts.iters = strtol(argv[3], &endptr, 10);
+
+    if (*endptr != '\0')
+    {
+      print_usage(argv[0]);
+      exit(0);
+    }
+  }
+
+  printf("opts.mode      = %s\n", mode_names[opts.mode]);
+  printf("opts.unit_size = %zu\n", opts.unit_size);
+  printf("opts.iters     = %zu\n", opts.iters);
+
+  fflush(stdout);
+  return opts;
+}
+
+static void clear_old_medium(struct rpc_options opts)
+{
+  switch (opts.mode)
+  {
+    case RPC_MODE_MMAP:
+      shm_unlink(MMAP_REQUEST_MEM_NAME);
+      shm_unlink(MMAP_REPLY_MEM_NAME);
+      break;
+
+    case RPC_MODE_SOCKET:
+      remove(UNIX_SOCK_PATH);
+      break;
+
+    case RPC_MODE_DUPLEX:
+      shm_unlink(DUPLEX_MEM_NAME);
+      break;
+  }
+}
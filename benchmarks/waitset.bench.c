@@ -0,0 +1,176 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "channels/channel.h"
+#include "channels/waitset.h"
+
+#define WAITSET_MEM_NAME      "/ipc_shr_open_waitset_78328"
+#define CHANNEL_MEM_NAME_FMT  "/ipc_shr_open_waitset_ch_%u_78329"
+#define DEFAULT_ITERS         1000000
+#define DEFAULT_CHANNELS      16
+#define UNIT_SIZE             8
+
+static void report_time(const char * label)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  printf("%s: %ld %09ld\n", label, ts.tv_sec, ts.tv_nsec);
+}
+
+struct waitset_options
+{
+  unsigned              channels;
+  size_t                iters;
+  ipc_waitset_order_t   order;
+};
+
+// channel names have to outlive the channels
+static char channel_names[IPC_WAITSET_MAX_CHANNELS][64];
+
+static void print_usage(const char * command)
+{
+  printf("USAGE: %s {fair|priority} [channels] [iters]\n", command);
+  printf("\n");
+  printf(" - {fair|priority} - order the consumer drains ready channels in\n");
+  printf(" - [channels]      - number of mmap channels, each one has a producer\n");
+  printf("                     defaults to 16, at most %d\n", IPC_WAITSET_MAX_CHANNELS);
+  printf(" - [iters]         - number of units over all the channels\n");
+  printf("                     defaults to 1000000\n");
+  printf("\n");
+  printf("   ex: %s fair 50\n", command);
+}
+
+static struct waitset_options demand_options(int argc, char ** argv);
+
+int main(int argc, char ** argv)
+{
+  struct waitset_options opts = demand_options(argc, argv);
+  size_t per_channel = opts.iters / opts.channels;
+
+  shm_unlink(WAITSET_MEM_NAME);
+  for (unsigned ch = 0; ch < opts.channels; ch++)
+  {
+    snprintf(channel_names[ch], sizeof(channel_names[ch]), CHANNEL_MEM_NAME_FMT, ch);
+    shm_unlink(channel_names[ch]);
+  }
+
+  // the consumer holds the channels before the producers run,
+  // so none of them goes away with its producer
+  ipc_channel_api_t * channels[IPC_WAITSET_MAX_CHANNELS];
+  size_t expected[IPC_WAITSET_MAX_CHANNELS] = { 0 };
+  ipc_waitset_t * waitset = ipc_waitset_create(WAITSET_MEM_NAME, opts.order);
+  assert(waitset != NULL);
+
+  for (unsigned ch = 0; ch < opts.channels; ch++)
+  {
+    channels[ch] = ipc_channel_create(channel_names[ch], UNIT_SIZE, IPC_CHANNEL_FLAVOR_MMAP);
+    assert(channels[ch] != NULL);
+
+    if (ipc_waitset_add(waitset, ch, channels[ch]))
+    {
+      printf("channel %u can't be added to the wait-set\n", ch);
+      exit(1);
+    }
+  }
+
+  for (unsigned ch = 0; ch < opts.channels; ch++)
+  {
+    if (!fork())
+    {
+      ipc_channel_api_t * ipc = ipc_channel_create(channel_names[ch],
+                                                   UNIT_SIZE,
+                                                   IPC_CHANNEL_FLAVOR_MMAP);
+      assert(ipc != NULL);
+
+      for (size_t i = 0; i < per_channel; i++)
+        ipc->push(ipc, &i);
+
+      ipc->destroy(ipc);
+      exit(0);
+    }
+  }
+
+  report_time("[BEGIN]");
+
+  for (size_t i = 0; i < per_channel * opts.channels; i++)
+  {
+    size_t unit;
+    unsigned ch = ipc_waitset_pop(waitset, &unit);
+
+    // every channel is still in order
+    assert(ch < opts.channels);
+    assert(unit == expected[ch]);
+    expected[ch]++;
+  }
+
+  report_time("[-END-]");
+
+  for (unsigned ch = 0; ch < opts.channels; ch++)
+    wait(&(int) {0});
+
+  ipc_waitset_destroy(waitset);
+  for (unsigned ch = 0; ch < opts.channels; ch++)
+    channels[ch]->destroy(channels[ch]);
+}
+
+static struct waitset_options demand_options(int argc, char ** argv)
+{
+  struct waitset_options opts =
+  {
+    .channels = DEFAULT_CHANNELS,
+    .iters    = DEFAULT_ITERS,
+  };
+
+  if (argc == 1 || argc > 4)
+  {
+    print_usage(argv[0]);
+    exit(0);
+  }
+
+  if (!strcmp(argv[1], "fair"))
+    opts.order = IPC_WAITSET_FAIR;
+  else if (!strcmp(argv[1], "priority"))
+    opts.order = IPC_WAITSET_PRIORITY;
+  else
+  {
+    print_usage(argv[0]);
+    exit(0);
+  }
+
+  if (argc >= 3)
+  {
+    char * endptr = NULL;
+    opts.channels = strtol(argv[2], &endptr, 10);
+
+    if (*endptr != '\0' || opts.channels == 0 || opts.channels > IPC_WAITSET_MAX_CHANNELS)
+    {
+      print_usage(argv[0]);
+      exit(0);
+    }
+  }
+
+  if (argc == 4)
+  {
+    char * endptr = NULL;
+    opts.iters = strtol(argv[3], &endptr, 10);
+
+    if (*endptr != '\0')
+    {
+      print_usage(argv[0]);
+      exit(0);
+    }
+  }
+
+  printf("opts.order     = %s\n", argv[1]);
+  printf("opts.channels  = %u\n", opts.channels);
+  printf("opts.iters     = %zu\n", opts.iters);
+
+  fflush(stdout);
+  return opts;
+}
@@ -0,0 +1,407 @@
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "channels/flavors/flavors.h"
+#include "channels/flavors/frame.h"
+
+#include "blob.h"
+
+#define VIRTUAL_PAGE_SIZE   4096
+#define POOL_SLOTS          8
+#define UNPOOLED            ((unsigned) -1)
+
+#define SIZE_SEALS          (F_SEAL_SHRINK | F_SEAL_GROW)
+#define WRITE_SEALS         (F_SEAL_WRITE | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+
+typedef struct
+{
+  int      fd;
+  char   * map;
+  size_t   capacity;
+  bool     busy;     // handed to the receiver, not released yet
+  bool     passed;   // the receiver has the memfd mapped already
+} blob_slot_t;
+
+typedef struct
+{
+  const char   * map;
+  size_t         capacity;
+} blob_mapping_t;
+
+struct ipc_blob_channel
+{
+  int               sockfd;
+  int               conn_sockfd;
+  ipc_blob_seal_t   seal;
+
+  // sender side: the pool and the blob being filled
+  blob_slot_t       pool[POOL_SLOTS];
+  blob_slot_t       unpooled;
+  unsigned          reserved;
+  size_t            reserved_size;
+
+  // receiver side: mappings of the sender's pool
+  blob_mapping_t    mappings[POOL_SLOTS];
+};
+
+static size_t capacity_for(size_t size)
+{
+  size_t capacity = VIRTUAL_PAGE_SIZE;
+
+  while (capacity < size)
+    capacity *= 2;
+
+  return capacity;
+}
+
+static void slot_close(blob_slot_t * slot)
+{
+  if (slot->map)
+    munmap(slot->map, slot->capacity);
+  if (slot->fd != -1)
+    close(slot->fd);
+
+  slot->fd = -1;
+  slot->map = NULL;
+  slot->capacity = 0;
+  slot->passed = false;
+}
+
+static int slot_open(blob_slot_t * slot, size_t capacity, unsigned seals)
+{
+  int ret = 0;
+
+  if ((slot->fd = memfd_create("ipc_blob", MFD_CLOEXEC | MFD_ALLOW_SEALING)) == -1)
+    goto failure;
+
+  if (ftruncate(slot->fd, capacity))
+    goto failure;
+
+  if (seals && fcntl(slot->fd, F_ADD_SEALS, seals))
+    goto failure;
+
+  slot->map = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, slot->fd, 0);
+  if (slot->map == MAP_FAILED)
+  {
+    slot->map = NULL;
+    goto failure;
+  }
+
+  slot->capacity = capacity;
+  slot->passed = false;
+  return 0;
+
+failure:
+  ret = errno;
+  slot_close(slot);
+  return ret;
+}
+
+// Takes a RELEASE frame off the socket, waits for one when `wait`
+static int take_release(ipc_blob_channel_t * channel, bool wait)
+{
+  ipc_frame_t frame;
+  int fd = -1;
+  int ret = 0;
+
+  if ((ret = ipc_frame_recv(channel->conn_sockfd, &frame, &fd, !wait)))
+    return ret;
+
+  if (fd != -1)
+    close(fd);
+
+  if (frame.kind != IPC_FRAME_RELEASE || frame.slot >= POOL_SLOTS)
+    return EPROTO;
+
+  channel->pool[frame.slot].busy = false;
+  return 0;
+}
+
+// A free slot big enough is reused as is, a smaller one gets a new memfd
+static int pool_acquire(ipc_blob_channel_t * channel, size_t size, unsigned * acquired)
+{
+  int ret = 0;
+
+  while (take_release(channel, false) == 0)
+    ;
+
+  for (;;)
+  {
+    int fit = -1, spare = -1;
+
+    for (unsigned i = 0; i < POOL_SLOTS; i++)
+    {
+      blob_slot_t * slot = &channel->pool[i];
+
+      if (slot->busy)
+        continue;
+
+      if (slot->capacity >= size && (fit == -1 || slot->capacity < channel->pool[fit].capacity))
+        fit = i;
+      if (spare == -1)
+        spare = i;
+    }
+
+    if (fit != -1)
+    {
+      *acquired = fit;
+      return 0;
+    }
+
+    if (spare != -1)
+    {
+      blob_slot_t * slot = &channel->pool[spare];
+      unsigned seals = channel->seal == IPC_BLOB_SEAL_SIZE ? SIZE_SEALS : 0;
+
+      slot_close(slot);
+      if ((ret = slot_open(slot, capacity_for(size), seals)))
+        return ret;
+
+      *acquired = spare;
+      return 0;
+    }
+
+    if ((ret = take_release(channel, true)))
+      return ret;
+  }
+}
+
+void * ipc_blob_reserve(ipc_blob_channel_t * channel, size_t size)
+{
+  assert(channel->reserved_size == 0 && "a reserved blob has not been submitted");
+
+  if (size == 0)
+    return NULL;
+
+  if (channel->seal == IPC_BLOB_SEAL_WRITE)
+  {
+    // sealed against writes once it is filled
+    if (slot_open(&channel->unpooled, capacity_for(size), 0))
+      return NULL;
+
+    channel->reserved = UNPOOLED;
+    channel->reserved_size = size;
+    return channel->unpooled.map;
+  }
+
+  unsigned slot;
+  if (pool_acquire(channel, size, &slot))
+    return NULL;
+
+  channel->pool[slot].busy = true;
+  channel->reserved = slot;
+  channel->reserved_size = size;
+  return channel->pool[slot].map;
+}
+
+int ipc_blob_submit(ipc_blob_channel_t * channel)
+{
+  ipc_frame_t frame =
+  {
+    .kind = IPC_FRAME_BLOB,
+    .slot = channel->reserved,
+    .size = channel->reserved_size,
+  };
+  int ret = 0;
+
+  assert(channel->reserved_size > 0 && "nothing is reserved");
+  channel->reserved_size = 0;
+
+  if (frame.slot == UNPOOLED)
+  {
+    blob_slot_t * slot = &channel->unpooled;
+
+    // writable mappings keep F_SEAL_WRITE away
+    munmap(slot->map, slot->capacity);
+    slot->map = NULL;
+
+    frame.capacity = slot->capacity;
+
+    if (fcntl(slot->fd, F_ADD_SEALS, WRITE_SEALS))
+      ret = errno;
+    else
+      ret = ipc_frame_send(channel->conn_sockfd, &frame, slot->fd);
+
+    slot_close(slot);
+    return ret;
+  }
+
+  blob_slot_t * slot = &channel->pool[frame.slot];
+  frame.capacity = slot->capacity;
+
+  if ((ret = ipc_frame_send(channel->conn_sockfd, &frame, slot->passed ? -1 : slot->fd)))
+  {
+    slot->busy = false;
+    return ret;
+  }
+
+  slot->passed = true;
+  return 0;
+}
+
+int ipc_blob_send(ipc_blob_channel_t * channel, const void * data, size_t size)
+{
+  void * payload = ipc_blob_reserve(channel, size);
+
+  if (payload == NULL)
+    return size == 0 ? EINVAL : ENOMEM;
+
+  memcpy(payload, data, size);
+  return ipc_blob_submit(channel);
+}
+
+// A memfd from the sender has to be sealed the way the channel says
+static int check_seals(ipc_blob_channel_t * channel, int fd, bool pooled)
+{
+  unsigned required = 0;
+
+  switch (channel->seal)
+  {
+    case IPC_BLOB_SEAL_NONE:  required = 0;           break;
+    case IPC_BLOB_SEAL_SIZE:  required = SIZE_SEALS;  break;
+    case IPC_BLOB_SEAL_WRITE: required = WRITE_SEALS; break;
+  }
+
+  if (pooled == (channel->seal == IPC_BLOB_SEAL_WRITE))
+    return EPROTO;
+
+  int seals = fcntl(fd, F_GET_SEALS);
+  if (seals == -1)
+    return errno;
+
+  return (seals & required) == required ? 0 : EPERM;
+}
+
+int ipc_blob_recv(ipc_blob_channel_t * channel, ipc_blob_t * blob)
+{
+  ipc_frame_t frame;
+  const char * map = NULL;
+  int fd = -1;
+  int ret = 0;
+
+  if ((ret = ipc_frame_recv(channel->conn_sockfd, &frame, &fd, false)))
+    return ret;
+
+  bool pooled = frame.slot != UNPOOLED;
+
+  if (frame.kind != IPC_FRAME_BLOB ||
+      frame.size > frame.capacity ||
+      (pooled && frame.slot >= POOL_SLOTS) ||
+      (fd == -1 && (!pooled || channel->mappings[frame.slot].map == NULL)))
+  {
+    ret = EPROTO;
+    goto exit;
+  }
+
+  if (fd != -1)
+  {
+    if ((ret = check_seals(channel, fd, pooled)))
+      goto exit;
+
+    map = mmap(NULL, frame.capacity, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+      ret = errno;
+      goto exit;
+    }
+
+    if (pooled)
+    {
+      // the sender has replaced the memfd of the slot
+      blob_mapping_t * mapping = &channel->mappings[frame.slot];
+
+      if (mapping->map)
+        munmap((void *) mapping->map, mapping->capacity);
+
+      mapping->map = map;
+      mapping->capacity = frame.capacity;
+    }
+  }
+  else
+  {
+    map = channel->mappings[frame.slot].map;
+
+    if (frame.capacity != channel->mappings[frame.slot].capacity)
+    {
+      ret = EPROTO;
+      goto exit;
+    }
+  }
+
+  blob->data = map;
+  blob->size = frame.size;
+  blob->slot = frame.slot;
+  blob->capacity = frame.capacity;
+
+exit:
+  if (fd != -1)
+    close(fd);
+  return ret;
+}
+
+void ipc_blob_release(ipc_blob_channel_t * channel, const ipc_blob_t * blob)
+{
+  if (blob->slot == UNPOOLED)
+  {
+    munmap((void *) blob->data, blob->capacity);
+    return;
+  }
+
+  ipc_frame_t frame = { .kind = IPC_FRAME_RELEASE, .slot = blob->slot };
+  ipc_frame_send(channel->conn_sockfd, &frame, -1);
+}
+
+ipc_blob_channel_t * ipc_blob_channel_create(const char * sock_path, ipc_blob_seal_t seal)
+{
+  ipc_blob_channel_t * channel = NULL;
+  int sockpair[2] = { -1, -1 };
+
+  if ((channel = calloc(1, sizeof(ipc_blob_channel_t))) == NULL)
+    goto failure;
+
+  if (ipc_domain_sockpair_connect(sock_path, &sockpair) != 0)
+    goto failure;
+
+  channel->sockfd = sockpair[0];
+  channel->conn_sockfd = sockpair[1];
+  channel->seal = seal;
+  channel->unpooled.fd = -1;
+
+  for (unsigned i = 0; i < POOL_SLOTS; i++)
+    channel->pool[i].fd = -1;
+
+  return channel;
+
+failure:
+  free(channel);
+  return NULL;
+}
+
+void ipc_blob_channel_destroy(ipc_blob_channel_t * channel)
+{
+  if (channel)
+  {
+    for (unsigned i = 0; i < POOL_SLOTS; i++)
+    {
+      slot_close(&channel->pool[i]);
+
+      if (channel->mappings[i].map)
+        munmap((void *) channel->mappings[i].map, channel->mappings[i].capacity);
+    }
+
+    slot_close(&channel->unpooled);
+
+    if (channel->sockfd != channel->conn_sockfd)
+      close(channel->sockfd);
+    close(channel->conn_sockfd);
+    free(channel);
+  }
+}
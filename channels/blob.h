@@ -0,0 +1,48 @@
+#ifndef IPC_BLOB_API_H
+#define IPC_BLOB_API_H
+
+#include <stddef.h>
+
+// Large payload hand-off next to the unix socket flavor: the payload
+// is written into a memfd once, the fd travels over the socket
+// (SCM_RIGHTS) and the receiver reads the pages in place.
+// One peer sends and the other one receives; memfds go back to
+// the sender's pool once released, and a receiver keeps the mappings
+// of the pool, so a recycled memfd travels and is mapped only once.
+
+typedef enum
+{
+  IPC_BLOB_SEAL_NONE,    // pooled memfds
+  IPC_BLOB_SEAL_SIZE,    // pooled memfds which can't shrink, a mapping never faults
+  IPC_BLOB_SEAL_WRITE,   // a memfd per blob sealed against writes, nothing is recycled
+} ipc_blob_seal_t;
+
+typedef struct
+{
+  const void * data;
+  size_t       size;
+
+  // private to the channel
+  unsigned     slot;
+  size_t       capacity;
+} ipc_blob_t;
+
+typedef struct ipc_blob_channel ipc_blob_channel_t;
+
+// Both peers use the same `seal`, a receiver refuses memfds lacking the seals
+ipc_blob_channel_t * ipc_blob_channel_create(const char * sock_path, ipc_blob_seal_t seal);
+void ipc_blob_channel_destroy(ipc_blob_channel_t * channel);
+
+// sender side, returns 0 or an errno value
+int ipc_blob_send(ipc_blob_channel_t * channel, const void * data, size_t size);
+
+// zero-copy sending: the payload is written right into the memory
+// returned by reserve, then submit passes it on
+void * ipc_blob_reserve(ipc_blob_channel_t * channel, size_t size);
+int ipc_blob_submit(ipc_blob_channel_t * channel);
+
+// receiver side, `blob->data` is readable until the blob is released
+int ipc_blob_recv(ipc_blob_channel_t * channel, ipc_blob_t * blob);
+void ipc_blob_release(ipc_blob_channel_t * channel, const ipc_blob_t * blob);
+
+#endif
@@ -1,3 +1,5 @@
+#include <errno.h>
+
 #include "flavors/flavors.h"
 
 #include "channel.h"
@@ -6,11 +8,36 @@ ipc_channel_api_t * ipc_channel_create(const char            * key,
                                        size_t                  unit_size,
                                        ipc_channel_flavors_t   flavor)
 {
+  return ipc_channel_create_with(key, unit_size, flavor, NULL);
+}
+
+ipc_channel_api_t * ipc_channel_create_with(const char                    * key,
+                                            size_t                          unit_size,
+                                            ipc_channel_flavors_t           flavor,
+                                            const ipc_channel_options_t   * opts)
+{
+  static const ipc_channel_options_t defaults = { 0 };
+
+  if (opts == NULL)
+    opts = &defaults;
+
   switch (flavor)
   {
-    case IPC_CHANNEL_FLAVOR_MMAP:   return ipc_channel_mmap_create(key, unit_size);
-    case IPC_CHANNEL_FLAVOR_SOCKET: return ipc_channel_socket_create(key, unit_size);
+    case IPC_CHANNEL_FLAVOR_MMAP:    return ipc_channel_mmap_create(key, unit_size, opts);
+    case IPC_CHANNEL_FLAVOR_SOCKET:  return ipc_channel_socket_create(key, unit_size, opts);
+    case IPC_CHANNEL_FLAVOR_URING:   return ipc_channel_uring_create(key, unit_size, opts);
+    case IPC_CHANNEL_FLAVOR_JOURNAL: return ipc_channel_journal_create(key, unit_size, opts);
+    case IPC_CHANNEL_FLAVOR_TCP:     return ipc_channel_tcp_create(key, unit_size, opts);
+    case IPC_CHANNEL_FLAVOR_INPROC:  return ipc_channel_inproc_create(key, unit_size);
   }
 
   return NULL;
 }
+
+int ipc_channel_gauges(ipc_channel_api_t * channel, ipc_channel_gauges_t * gauges)
+{
+  if (channel->gauges == NULL)
+    return ENOTSUP;
+
+  return channel->gauges(channel, gauges);
+}
@@ -1,27 +1,123 @@
 #ifndef IPC_CHANNEL_API_H
 #define IPC_CHANNEL_API_H
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 typedef enum
 {
   IPC_CHANNEL_FLAVOR_MMAP,
   IPC_CHANNEL_FLAVOR_SOCKET,
+  IPC_CHANNEL_FLAVOR_URING,
+  IPC_CHANNEL_FLAVOR_JOURNAL,
+  IPC_CHANNEL_FLAVOR_TCP,
+  IPC_CHANNEL_FLAVOR_INPROC,   // threads of one process, `key` is a process-local name
 } ipc_channel_flavors_t;
 
-typedef void (* ipc_channel_push)(void * self, const void * buffer);
+typedef enum
+{
+  IPC_JOURNAL_SYNC_NONE,       // the kernel writes records back whenever it likes
+  IPC_JOURNAL_SYNC_MSYNC,      // msync(MS_SYNC) of the records appended since the last commit
+  IPC_JOURNAL_SYNC_FDATASYNC,  // fdatasync of the whole journal file
+} ipc_journal_sync_t;
+
+// Flavor specific tuning, zero-initialized fields mean defaults
+typedef struct
+{
+  struct
+  {
+    // a consumer wakes a sleeping producer once the ring holds
+    // no more than `low_watermark` units (defaults to half of the ring)
+    size_t     low_watermark;
+  } mmap;
+
+  struct
+  {
+    // credit-based flow control: a producer pushes at most `credits` units
+    // ahead of the consumer, which grants them back every `grant_every` pops
+    // (defaults to a quarter of `credits`), 0 turns it off;
+    // both peers have to use the same settings, and the grants share
+    // the stream, so with credits a side only pushes or only pops:
+    // a push after a pop returns EINVAL, a pop after a push aborts
+    unsigned   credits;
+    unsigned   grant_every;
+  } socket;
+
+  struct
+  {
+    unsigned   depth;    // sends/receives kept in flight, defaults to 64
+    bool       sqpoll;   // a kernel thread polls submissions, no syscalls on push
+  } uring;
+
+  struct
+  {
+    // bytes of units the (sparse) journal file holds, defaults to 256 MiB,
+    // an existing journal keeps the capacity it was created with
+    size_t               capacity;
+    // a producer makes its records durable every `sync_every` pushes
+    // (defaults to 1024), only records made durable survive a restart
+    ipc_journal_sync_t   sync;
+    unsigned             sync_every;
+    // a consumer reads from the beginning with a cursor of its own,
+    // instead of resuming from the offset consumers stored in the journal
+    bool                 replay;
+  } journal;
+
+  struct
+  {
+    int        sndbuf;      // SO_SNDBUF bytes, 0 keeps the system default
+    int        rcvbuf;      // SO_RCVBUF bytes, 0 keeps the system default
+    int        busy_poll;   // SO_BUSY_POLL microseconds, 0 disables it
+  } tcp;
+} ipc_channel_options_t;
+
+// returns 0 or an errno value, e.g. ENOSPC when a journal is full,
+// EIO when its group commit fails, or ECONNRESET/EPIPE when
+// a socket consumer has gone
+typedef int  (* ipc_channel_push)(void * self, const void * buffer);
 typedef void (* ipc_channel_pop)(void * self, void * buffer);
 typedef void (* ipc_channel_destroy)(void * self);
+// pops a unit if there is one, never blocks
+typedef bool (* ipc_channel_try_pop)(void * self, void * buffer);
+// producers raise `slot` of the wait-set `waitset` on every push,
+// a NULL `waitset` drops the binding
+typedef int  (* ipc_channel_bind)(void * self, const char * waitset, unsigned slot);
+
+// Queue depth as seen by one side of a channel, for monitoring
+// and for producers adapting their batches
+typedef struct
+{
+  size_t     outbound_bytes;   // pushed by this side, not received by the peer yet
+  size_t     inbound_bytes;    // received by this side, not popped yet
+  size_t     credits;          // units this side may push before it blocks, SIZE_MAX when unknown
+  uint64_t   stalls;           // pushes which had to wait for room
+} ipc_channel_gauges_t;
+
+typedef int  (* ipc_channel_gauge)(void * self, ipc_channel_gauges_t * gauges);
 
+// `try_pop`, `bind` and `gauges` are optional, NULL when a flavor lacks them
 typedef struct
 {
   ipc_channel_push    push;
   ipc_channel_pop     pop;
   ipc_channel_destroy destroy;
+  ipc_channel_try_pop try_pop;
+  ipc_channel_bind    bind;
+  ipc_channel_gauge   gauges;
 } ipc_channel_api_t;
 
 ipc_channel_api_t * ipc_channel_create(const char            * key,
                                        size_t                  unit_size,
                                        ipc_channel_flavors_t   flavor);
 
+// `opts` may be NULL, which is the same as `ipc_channel_create`
+ipc_channel_api_t * ipc_channel_create_with(const char                    * key,
+                                            size_t                          unit_size,
+                                            ipc_channel_flavors_t           flavor,
+                                            const ipc_channel_options_t   * opts);
+
+// Returns 0, ENOTSUP when the flavor has no gauges, or the error of reading them
+int ipc_channel_gauges(ipc_channel_api_t * channel, ipc_channel_gauges_t * gauges);
+
 #endif
@@ -0,0 +1,434 @@
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "channels/psync/cv.h"
+#include "channels/psync/mutex.h"
+#include "channels/psync/shm.h"
+
+#include "duplex.h"
+
+#define RING_SLOTS          1024
+#define SLOT_ALIGN          alignof(max_align_t)
+#define NO_MOVE             RING_SLOTS
+
+// ids carry the pid of the caller in the low bits,
+// pids stay below PID_MAX_LIMIT which is 2^22 on 64-bit Linux
+#define ID_PID_BITS         22
+
+// how long a full ring waits before it looks for dead callers
+#define REAP_INTERVAL_MS    100
+
+typedef struct
+{
+  ipc_mutex_t  mutex;
+  ipc_cv_t     cv_not_full;
+  ipc_cv_t     cv_not_empty;
+  size_t       head;
+  size_t       tail;
+  size_t       data_offset;
+
+  // a slot taken out of the middle gets the head one, the move is
+  // recorded first, so when its owner dies halfway the next one redoes it
+  size_t       move_from;
+  size_t       move_to;
+} duplex_ring_t;
+
+typedef struct
+{
+  ipc_corr_id_t id;
+
+  __attribute__ ((aligned(SLOT_ALIGN)))
+  char          payload[];
+} duplex_slot_t;
+
+typedef struct
+{
+  ipc_shm_header_t header;
+
+  atomic_ullong    next_id;
+  size_t           slot_size;
+  duplex_ring_t    requests;
+  duplex_ring_t    replies;
+
+  __attribute__ ((aligned(SLOT_ALIGN)))
+  char             data[];
+} duplex_shared_t;
+
+struct ipc_duplex
+{
+  const char        * name;
+  duplex_shared_t   * shared;
+  size_t              unit_size;
+  ipc_duplex_side_t   side;
+  pid_t               pid;
+};
+
+static size_t slot_size_of(size_t unit_size)
+{
+  size_t size = sizeof(duplex_slot_t) + unit_size;
+  return (size + SLOT_ALIGN - 1) / SLOT_ALIGN * SLOT_ALIGN;
+}
+
+static size_t shared_size_of(size_t unit_size)
+{
+  return sizeof(duplex_shared_t) + 2 * RING_SLOTS * slot_size_of(unit_size);
+}
+
+static duplex_slot_t * ring_slot(duplex_shared_t * shared,
+                                 duplex_ring_t   * ring,
+                                 size_t            idx)
+{
+  char * base = shared->data + ring->data_offset;
+  return (duplex_slot_t *) (base + idx * shared->slot_size);
+}
+
+static bool ring_is_empty(const duplex_ring_t * ring)
+{
+  return ring->head == ring->tail;
+}
+
+static bool ring_is_full(const duplex_ring_t * ring)
+{
+  return (ring->tail + 1) % RING_SLOTS == ring->head;
+}
+
+static pid_t caller_of(ipc_corr_id_t id)
+{
+  return id & ((1u << ID_PID_BITS) - 1);
+}
+
+static bool is_alive(pid_t pid)
+{
+  return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+// Slots are written by a process which may be killed at any instruction,
+// the compiler must not move the stores publishing them ahead of the data
+static void store_barrier(void)
+{
+  atomic_signal_fence(memory_order_seq_cst);
+}
+
+// The head slot is left as it is until `head` moves,
+// so the copy is the same however many times it is redone
+static void ring_finish_move(ipc_duplex_t * duplex, duplex_ring_t * ring)
+{
+  if (ring->move_to == NO_MOVE)
+    return;
+
+  if (ring->head == ring->move_from)
+  {
+    duplex_slot_t * head = ring_slot(duplex->shared, ring, ring->head);
+    duplex_slot_t * slot = ring_slot(duplex->shared, ring, ring->move_to);
+
+    slot->id = head->id;
+    memcpy(slot->payload, head->payload, duplex->unit_size);
+    store_barrier();
+    ring->head = (ring->head + 1) % RING_SLOTS;
+  }
+
+  store_barrier();
+  ring->move_to = NO_MOVE;
+}
+
+// Takes the slot `idx` out of the ring, messages are matched by id,
+// so their order doesn't matter: the head one takes its place
+static void ring_take(ipc_duplex_t * duplex, duplex_ring_t * ring, size_t idx)
+{
+  if (idx == ring->head)
+  {
+    ring->head = (ring->head + 1) % RING_SLOTS;
+  }
+  else
+  {
+    ring->move_from = ring->head;
+    store_barrier();
+    ring->move_to = idx;
+    store_barrier();
+    ring_finish_move(duplex, ring);
+  }
+
+  ipc_cv_notify_one(&ring->cv_not_full);
+}
+
+// Nobody collects the messages of a caller which has died
+static unsigned ring_drop_dead(ipc_duplex_t * duplex, duplex_ring_t * ring)
+{
+  unsigned dropped = 0;
+  size_t idx = ring->head;
+
+  while (idx != ring->tail)
+  {
+    duplex_slot_t * slot = ring_slot(duplex->shared, ring, idx);
+
+    if (is_alive(caller_of(slot->id)))
+    {
+      idx = (idx + 1) % RING_SLOTS;
+      continue;
+    }
+
+    // a slot past the head gets the head one, which is checked already
+    bool at_head = idx == ring->head;
+    ring_take(duplex, ring, idx);
+    dropped++;
+
+    idx = at_head ? ring->head : (idx + 1) % RING_SLOTS;
+  }
+
+  return dropped;
+}
+
+// An owner which died may have left a move halfway and its notification
+// lost, a full ring which stayed full may hold messages nobody takes
+static void ring_recover(ipc_duplex_t * duplex, duplex_ring_t * ring, int ret)
+{
+  if (ret == EOWNERDEAD)
+  {
+    ring_finish_move(duplex, ring);
+    ring_drop_dead(duplex, ring);
+
+    ipc_cv_notify_all(&ring->cv_not_empty);
+    ipc_cv_notify_all(&ring->cv_not_full);
+  }
+  else if (ret == ETIMEDOUT)
+  {
+    ring_drop_dead(duplex, ring);
+  }
+}
+
+#define RING_CRITICAL_SECTION(duplex, ring)                                \
+  IPC_DEFER(ring_recover(duplex, ring, ipc_mutex_lock(&(ring)->mutex)),    \
+            ipc_mutex_unlock(&(ring)->mutex))
+
+static void ring_push(ipc_duplex_t  * duplex,
+                      duplex_ring_t * ring,
+                      ipc_corr_id_t   id,
+                      const void    * buffer)
+{
+  const struct timespec reap_interval = { .tv_nsec = REAP_INTERVAL_MS * 1000000 };
+
+  RING_CRITICAL_SECTION(duplex, ring)
+  {
+    while (ring_is_full(ring))
+    {
+      ring_recover(duplex, ring, ipc_cv_timedwait(&ring->cv_not_full, &ring->mutex, &reap_interval));
+    }
+
+    duplex_slot_t * slot = ring_slot(duplex->shared, ring, ring->tail);
+    slot->id = id;
+    memcpy(slot->payload, buffer, duplex->unit_size);
+    store_barrier();
+    ring->tail = (ring->tail + 1) % RING_SLOTS;
+
+    // replies are matched by id, every waiter has to check the new head
+    ipc_cv_notify_all(&ring->cv_not_empty);
+  }
+}
+
+static ipc_corr_id_t ring_pop_any(ipc_duplex_t  * duplex,
+                                  duplex_ring_t * ring,
+                                  void          * buffer)
+{
+  ipc_corr_id_t id = 0;
+
+  RING_CRITICAL_SECTION(duplex, ring)
+  {
+    while (ring_is_empty(ring))
+    {
+      ring_recover(duplex, ring, ipc_cv_wait(&ring->cv_not_empty, &ring->mutex));
+    }
+
+    duplex_slot_t * slot = ring_slot(duplex->shared, ring, ring->head);
+    id = slot->id;
+    memcpy(buffer, slot->payload, duplex->unit_size);
+    ring_take(duplex, ring, ring->head);
+
+    if (!ring_is_empty(ring))
+    {
+      ipc_cv_notify_all(&ring->cv_not_empty);
+    }
+  }
+
+  return id;
+}
+
+// Finds the reply `id` anywhere between head and tail, replies complete
+// out of order and a reply nobody waits for must not block the others;
+// returns NO_MOVE when it isn't there
+static size_t ring_find(ipc_duplex_t  * duplex,
+                        duplex_ring_t * ring,
+                        ipc_corr_id_t   id)
+{
+  for (size_t idx = ring->head; idx != ring->tail; idx = (idx + 1) % RING_SLOTS)
+  {
+    if (ring_slot(duplex->shared, ring, idx)->id == id)
+      return idx;
+  }
+
+  return NO_MOVE;
+}
+
+static void ring_pop_id(ipc_duplex_t  * duplex,
+                        duplex_ring_t * ring,
+                        ipc_corr_id_t   id,
+                        void          * buffer)
+{
+  RING_CRITICAL_SECTION(duplex, ring)
+  {
+    size_t idx;
+
+    while ((idx = ring_find(duplex, ring, id)) == NO_MOVE)
+    {
+      ring_recover(duplex, ring, ipc_cv_wait(&ring->cv_not_empty, &ring->mutex));
+    }
+
+    memcpy(buffer, ring_slot(duplex->shared, ring, idx)->payload, duplex->unit_size);
+    ring_take(duplex, ring, idx);
+  }
+}
+
+static int ring_init(duplex_ring_t * ring, size_t data_offset)
+{
+  int ret = 0;
+
+  if ((ret = ipc_mutex_init(&ring->mutex)))
+    return ret;
+
+  if ((ret = ipc_cv_init(&ring->cv_not_empty)))
+    return ret;
+
+  if ((ret = ipc_cv_init(&ring->cv_not_full)))
+    return ret;
+
+  ring->head = 0;
+  ring->tail = 0;
+  ring->data_offset = data_offset;
+  ring->move_from = 0;
+  ring->move_to = NO_MOVE;
+
+  return ret;
+}
+
+static void ring_destroy(duplex_ring_t * ring)
+{
+  ipc_mutex_destroy(&ring->mutex);
+  ipc_cv_destroy(&ring->cv_not_empty);
+  ipc_cv_destroy(&ring->cv_not_full);
+}
+
+static int duplex_shared_create(void * shared_mem, void * arg)
+{
+  int ret = 0;
+  ipc_duplex_t * duplex = arg;
+  duplex_shared_t * shared = shared_mem;
+
+  shared->slot_size = slot_size_of(duplex->unit_size);
+  atomic_init(&shared->next_id, 1);
+
+  if ((ret = ring_init(&shared->requests, 0)))
+    return ret;
+
+  if ((ret = ring_init(&shared->replies, RING_SLOTS * shared->slot_size)))
+    return ret;
+
+  return ret;
+}
+
+static void duplex_shared_destroy(void * shared_mem, void * arg)
+{
+  duplex_shared_t * shared = shared_mem;
+
+  ring_destroy(&shared->requests);
+  ring_destroy(&shared->replies);
+}
+
+ipc_duplex_t * ipc_duplex_create(const char        * name,
+                                 size_t              unit_size,
+                                 ipc_duplex_side_t   side)
+{
+  ipc_duplex_t * duplex = NULL;
+  void * shared_mem = NULL;
+
+  if (unit_size == 0)
+    goto failure;
+
+  if ((duplex = malloc(sizeof(ipc_duplex_t))) == NULL)
+    goto failure;
+
+  duplex->unit_size = unit_size;
+
+  if (ipc_shm_attach(name,
+                     shared_size_of(unit_size),
+                     unit_size,
+                     duplex_shared_create,
+                     duplex,
+                     &shared_mem))
+    goto failure;
+
+  duplex->name = name; // ISSUE: implicit static lifetime assumption
+  duplex->shared = shared_mem;
+  duplex->side = side;
+  duplex->pid = getpid();
+
+  return duplex;
+
+failure:
+  free(duplex);
+  return NULL;
+}
+
+void ipc_duplex_destroy(ipc_duplex_t * duplex)
+{
+  if (duplex)
+  {
+    ipc_shm_detach(duplex->name, duplex->shared, duplex_shared_destroy, duplex);
+    free(duplex);
+  }
+}
+
+ipc_corr_id_t ipc_duplex_send(ipc_duplex_t * duplex, const void * request)
+{
+  assert(duplex->side == IPC_DUPLEX_CLIENT);
+
+  ipc_corr_id_t seq = atomic_fetch_add_explicit(&duplex->shared->next_id,
+                                                1,
+                                                memory_order_relaxed);
+  ipc_corr_id_t id = seq << ID_PID_BITS | (ipc_corr_id_t) duplex->pid;
+
+  ring_push(duplex, &duplex->shared->requests, id, request);
+  return id;
+}
+
+void ipc_duplex_wait(ipc_duplex_t * duplex, ipc_corr_id_t id, void * reply)
+{
+  assert(duplex->side == IPC_DUPLEX_CLIENT);
+
+  ring_pop_id(duplex, &duplex->shared->replies, id, reply);
+}
+
+void ipc_duplex_call(ipc_duplex_t * duplex, const void * request, void * reply)
+{
+  ipc_duplex_wait(duplex, ipc_duplex_send(duplex, request), reply);
+}
+
+ipc_corr_id_t ipc_duplex_recv(ipc_duplex_t * duplex, void * request)
+{
+  assert(duplex->side == IPC_DUPLEX_SERVER);
+
+  return ring_pop_any(duplex, &duplex->shared->requests, request);
+}
+
+void ipc_duplex_reply(ipc_duplex_t * duplex, ipc_corr_id_t id, const void * reply)
+{
+  assert(duplex->side == IPC_DUPLEX_SERVER);
+
+  ring_push(duplex, &duplex->shared->replies, id, reply);
+}
@@ -0,0 +1,40 @@
+#ifndef IPC_DUPLEX_API_H
+#define IPC_DUPLEX_API_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Request/response channel: a single shared memory segment holding
+// a request ring (client -> server) and a reply ring (server -> client).
+// Every message carries a correlation id, so concurrent callers
+// receive exactly their own replies, in whatever order they complete.
+// The id carries the pid of the caller, the process which waits for it.
+// A reply which is never waited for keeps its slot of the reply ring
+// until its caller exits, a full ring drops the messages of dead callers.
+
+typedef enum
+{
+  IPC_DUPLEX_CLIENT,
+  IPC_DUPLEX_SERVER,
+} ipc_duplex_side_t;
+
+typedef uint64_t ipc_corr_id_t;
+
+typedef struct ipc_duplex ipc_duplex_t;
+
+ipc_duplex_t * ipc_duplex_create(const char        * name,
+                                 size_t              unit_size,
+                                 ipc_duplex_side_t   side);
+
+void ipc_duplex_destroy(ipc_duplex_t * duplex);
+
+// client side
+ipc_corr_id_t ipc_duplex_send(ipc_duplex_t * duplex, const void * request);
+void ipc_duplex_wait(ipc_duplex_t * duplex, ipc_corr_id_t id, void * reply);
+void ipc_duplex_call(ipc_duplex_t * duplex, const void * request, void * reply);
+
+// server side
+ipc_corr_id_t ipc_duplex_recv(ipc_duplex_t * duplex, void * request);
+void ipc_duplex_reply(ipc_duplex_t * duplex, ipc_corr_id_t id, const void * reply);
+
+#endif
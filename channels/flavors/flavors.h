@@ -3,7 +3,25 @@
 
 #include "../channel.h"
 
-ipc_channel_api_t * ipc_channel_mmap_create(const char * name, size_t unit_size);
-ipc_channel_api_t * ipc_channel_socket_create(const char * port, size_t unit_size);
+ipc_channel_api_t * ipc_channel_mmap_create(const char                  * name,
+                                            size_t                        unit_size,
+                                            const ipc_channel_options_t * opts);
+ipc_channel_api_t * ipc_channel_socket_create(const char                  * sock_path,
+                                              size_t                        unit_size,
+                                              const ipc_channel_options_t * opts);
+ipc_channel_api_t * ipc_channel_uring_create(const char                  * sock_path,
+                                             size_t                        unit_size,
+                                             const ipc_channel_options_t * opts);
+ipc_channel_api_t * ipc_channel_journal_create(const char                  * path,
+                                               size_t                        unit_size,
+                                               const ipc_channel_options_t * opts);
+// `address` is "host:port"
+ipc_channel_api_t * ipc_channel_tcp_create(const char                  * address,
+                                           size_t                        unit_size,
+                                           const ipc_channel_options_t * opts);
+ipc_channel_api_t * ipc_channel_inproc_create(const char * name, size_t unit_size);
+
+// Binds `sock_path` and accepts a peer, or connects to it when bound already
+int ipc_domain_sockpair_connect(const char * sock_path, int (*sockpair)[2]);
 
 #endif
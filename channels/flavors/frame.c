@@ -0,0 +1,82 @@
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "frame.h"
+
+int ipc_frame_send(int sockfd, const ipc_frame_t * frame, int fd)
+{
+  union
+  {
+    char             buffer[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr   align;
+  } control;
+
+  struct iovec iov = { .iov_base = (void *) frame, .iov_len = sizeof(*frame) };
+  struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+
+  if (fd != -1)
+  {
+    memset(&control, 0, sizeof(control));
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  }
+
+  // a small write to a unix stream is never split
+  ssize_t ret = sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+
+  if (ret < 0)
+    return errno;
+
+  return ret == sizeof(*frame) ? 0 : EPROTO;
+}
+
+int ipc_frame_recv(int sockfd, ipc_frame_t * frame, int * fd, bool nonblock)
+{
+  union
+  {
+    char             buffer[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr   align;
+  } control;
+
+  struct iovec iov = { .iov_base = frame, .iov_len = sizeof(*frame) };
+  struct msghdr msg =
+  {
+    .msg_iov        = &iov,
+    .msg_iovlen     = 1,
+    .msg_control    = control.buffer,
+    .msg_controllen = sizeof(control.buffer),
+  };
+
+  *fd = -1;
+
+  ssize_t ret = recvmsg(sockfd, &msg, MSG_CMSG_CLOEXEC | (nonblock ? MSG_DONTWAIT : 0));
+
+  if (ret < 0)
+    return errno;
+
+  if (ret == 0)
+    return ECONNRESET;
+
+  struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+    memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+
+  // frames are written whole, the rest of a frame is on its way
+  if (ret < sizeof(*frame) &&
+      recv(sockfd, (char *) frame + ret, sizeof(*frame) - ret, MSG_WAITALL) != sizeof(*frame) - ret)
+  {
+    if (*fd != -1)
+      close(*fd);
+    return EPROTO;
+  }
+
+  return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef IPC_CHANNEL_FRAME_H
+#define IPC_CHANNEL_FRAME_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Fixed-size control frames exchanged over a unix stream socket,
+// a frame may carry a file descriptor (SCM_RIGHTS) along with it
+
+typedef enum
+{
+  IPC_FRAME_BLOB,      // a blob of `size` bytes sits in pool `slot`
+  IPC_FRAME_RELEASE,   // the receiver is done with pool `slot`
+  IPC_FRAME_CREDIT,    // the consumer grants `size` more units
+} ipc_frame_kind_t;
+
+typedef struct
+{
+  uint32_t   kind;
+  uint32_t   slot;
+  uint64_t   size;
+  uint64_t   capacity;
+} ipc_frame_t;
+
+// Returns 0 or an errno value, `fd` is passed when it is not -1
+int ipc_frame_send(int sockfd, const ipc_frame_t * frame, int fd);
+
+// Returns 0 or an errno value (EAGAIN for `nonblock` when nothing is there),
+// `*fd` is the passed descriptor or -1
+int ipc_frame_recv(int sockfd, ipc_frame_t * frame, int * fd, bool nonblock);
+
+#endif
@@ -0,0 +1,354 @@
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "channels/psync/futex.h"
+
+#include "channels/channel.h"
+#include "flavors.h"
+
+#define CACHE_LINE_SIZE     64
+#define RING_BYTES          (1024 * 1024)
+#define RING_MIN_UNITS      256
+
+// A bounded MPMC ring on the heap: every slot carries a sequence number
+// telling whose turn it is, producers and consumers claim slots with
+// a CAS on their own position and never take a lock.
+// The futex words are private, the threads of one process share the ring.
+typedef struct inproc_ring
+{
+  alignas(CACHE_LINE_SIZE)
+  atomic_size_t          enqueue_pos;
+
+  alignas(CACHE_LINE_SIZE)
+  atomic_size_t          dequeue_pos;
+
+  // bumped only when the other side sleeps, which it says with
+  // its `waiting_*` count and by arming `*_armed`, a notifier disarms it
+  alignas(CACHE_LINE_SIZE)
+  atomic_uint            not_empty;
+  atomic_uint            waiting_consumers;
+  atomic_uint            consumers_armed;
+
+  alignas(CACHE_LINE_SIZE)
+  atomic_uint            not_full;
+  atomic_uint            waiting_producers;
+  atomic_uint            producers_armed;
+
+  // registry entry, guarded by `registry_lock`
+  char                 * name;
+  unsigned               ref_count;
+  struct inproc_ring   * next;
+
+  size_t                 unit_size;
+  size_t                 slot_size;
+  size_t                 mask;
+  char                 * slots;
+} inproc_ring_t;
+
+typedef struct
+{
+  atomic_size_t   seq;
+
+  __attribute__ ((aligned(alignof(max_align_t))))
+  char            data[];
+} inproc_slot_t;
+
+typedef struct
+{
+  ipc_channel_api_t   api;
+  inproc_ring_t     * ring;
+} ipc_channel_inproc_t;
+
+static_assert(offsetof(ipc_channel_inproc_t, api) == 0,
+              "Channel struct must has `api` the first field");
+
+// Rings of the process by name, a ring lives while a channel holds it
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static inproc_ring_t * registry = NULL;
+
+static inproc_slot_t * ring_slot(inproc_ring_t * ring, size_t pos)
+{
+  return (inproc_slot_t *) (ring->slots + (pos & ring->mask) * ring->slot_size);
+}
+
+static bool try_push(inproc_ring_t * ring, const void * buffer)
+{
+  size_t pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+
+  for (;;)
+  {
+    inproc_slot_t * slot = ring_slot(ring, pos);
+    size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+
+    if (diff < 0)
+      return false;
+
+    if (diff == 0 &&
+        atomic_compare_exchange_weak_explicit(&ring->enqueue_pos, &pos, pos + 1,
+                                              memory_order_relaxed, memory_order_relaxed))
+    {
+      memcpy(slot->data, buffer, ring->unit_size);
+      atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+      return true;
+    }
+
+    if (diff > 0)
+      pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+  }
+}
+
+static bool try_take(inproc_ring_t * ring, void * buffer)
+{
+  size_t pos = atomic_load_explicit(&ring->dequeue_pos, memory_order_relaxed);
+
+  for (;;)
+  {
+    inproc_slot_t * slot = ring_slot(ring, pos);
+    size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+
+    if (diff < 0)
+      return false;
+
+    if (diff == 0 &&
+        atomic_compare_exchange_weak_explicit(&ring->dequeue_pos, &pos, pos + 1,
+                                              memory_order_relaxed, memory_order_relaxed))
+    {
+      memcpy(buffer, slot->data, ring->unit_size);
+      atomic_store_explicit(&slot->seq, pos + ring->mask + 1, memory_order_release);
+      return true;
+    }
+
+    if (diff > 0)
+      pos = atomic_load_explicit(&ring->dequeue_pos, memory_order_relaxed);
+  }
+}
+
+// A sleeper counts itself and arms the word before its last look
+// at the ring, a notifier checks the count after its change, so one
+// of them sees the other. The notifier which disarms the word wakes
+// every sleeper, the ones woken but not running yet don't cost
+// a wake up on every push, and a sleeper armed after that is
+// woken by the next notifier. Sleepers drop only their own count.
+static void notify(atomic_uint * word, atomic_uint * waiting, atomic_uint * armed)
+{
+  atomic_thread_fence(memory_order_seq_cst);
+
+  if (atomic_load_explicit(waiting, memory_order_relaxed) == 0)
+    return;
+
+  if (atomic_exchange(armed, 0))
+  {
+    atomic_fetch_add(word, 1);
+    ipc_futex_wake_private(word, INT_MAX);
+  }
+}
+
+static void arm(atomic_uint * waiting, atomic_uint * armed)
+{
+  atomic_fetch_add(waiting, 1);
+  atomic_store(armed, 1);
+  atomic_thread_fence(memory_order_seq_cst);
+}
+
+static int push(void * self, const void * buffer)
+{
+  ipc_channel_inproc_t * ipc = self;
+  inproc_ring_t * ring = ipc->ring;
+
+  while (!try_push(ring, buffer))
+  {
+    unsigned seen = atomic_load(&ring->not_full);
+    arm(&ring->waiting_producers, &ring->producers_armed);
+
+    bool pushed = try_push(ring, buffer);
+    if (!pushed)
+      ipc_futex_wait_private(&ring->not_full, seen, NULL);
+
+    atomic_fetch_sub(&ring->waiting_producers, 1);
+
+    if (pushed)
+      break;
+  }
+
+  notify(&ring->not_empty, &ring->waiting_consumers, &ring->consumers_armed);
+  return 0;
+}
+
+static bool try_pop(void * self, void * buffer)
+{
+  ipc_channel_inproc_t * ipc = self;
+  inproc_ring_t * ring = ipc->ring;
+
+  if (!try_take(ring, buffer))
+    return false;
+
+  notify(&ring->not_full, &ring->waiting_producers, &ring->producers_armed);
+  return true;
+}
+
+static void pop(void * self, void * buffer)
+{
+  ipc_channel_inproc_t * ipc = self;
+  inproc_ring_t * ring = ipc->ring;
+
+  while (!try_take(ring, buffer))
+  {
+    unsigned seen = atomic_load(&ring->not_empty);
+    arm(&ring->waiting_consumers, &ring->consumers_armed);
+
+    bool taken = try_take(ring, buffer);
+    if (!taken)
+      ipc_futex_wait_private(&ring->not_empty, seen, NULL);
+
+    atomic_fetch_sub(&ring->waiting_consumers, 1);
+
+    if (taken)
+      break;
+  }
+
+  notify(&ring->not_full, &ring->waiting_producers, &ring->producers_armed);
+}
+
+static void ring_free(inproc_ring_t * ring)
+{
+  if (ring)
+  {
+    free(ring->slots);
+    free(ring->name);
+    free(ring);
+  }
+}
+
+static inproc_ring_t * ring_create(const char * name, size_t unit_size)
+{
+  inproc_ring_t * ring = NULL;
+
+  if ((ring = aligned_alloc(CACHE_LINE_SIZE, sizeof(inproc_ring_t))) == NULL)
+    goto failure;
+
+  memset(ring, 0, sizeof(inproc_ring_t));
+
+  if ((ring->name = strdup(name)) == NULL)
+    goto failure;
+
+  size_t units = RING_MIN_UNITS;
+  while (units * unit_size < RING_BYTES)
+    units *= 2;
+
+  size_t slot_size = sizeof(inproc_slot_t) + unit_size;
+  slot_size = (slot_size + alignof(inproc_slot_t) - 1) / alignof(inproc_slot_t) * alignof(inproc_slot_t);
+
+  if ((ring->slots = aligned_alloc(CACHE_LINE_SIZE, units * slot_size)) == NULL)
+    goto failure;
+
+  ring->unit_size = unit_size;
+  ring->slot_size = slot_size;
+  ring->mask = units - 1;
+
+  for (size_t pos = 0; pos < units; pos++)
+    atomic_init(&ring_slot(ring, pos)->seq, pos);
+
+  atomic_init(&ring->enqueue_pos, 0);
+  atomic_init(&ring->dequeue_pos, 0);
+  atomic_init(&ring->not_empty, 0);
+  atomic_init(&ring->not_full, 0);
+  atomic_init(&ring->waiting_consumers, 0);
+  atomic_init(&ring->waiting_producers, 0);
+  atomic_init(&ring->consumers_armed, 0);
+  atomic_init(&ring->producers_armed, 0);
+
+  return ring;
+
+failure:
+  ring_free(ring);
+  return NULL;
+}
+
+static void destroy(void * self)
+{
+  ipc_channel_inproc_t * ipc = self;
+  if (ipc)
+  {
+    inproc_ring_t * ring = ipc->ring;
+
+    IPC_EOK(pthread_mutex_lock(&registry_lock));
+
+    if (--ring->ref_count == 0)
+    {
+      inproc_ring_t ** link = &registry;
+      while (*link != ring)
+        link = &(*link)->next;
+
+      *link = ring->next;
+    }
+    else
+    {
+      ring = NULL;
+    }
+
+    IPC_EOK(pthread_mutex_unlock(&registry_lock));
+
+    ring_free(ring);
+    free(ipc);
+  }
+}
+
+ipc_channel_api_t * ipc_channel_inproc_create(const char * name, size_t unit_size)
+{
+  ipc_channel_inproc_t * ipc = NULL;
+  inproc_ring_t * ring = NULL;
+
+  if (__builtin_popcount(unit_size) != 1)
+    return NULL;
+
+  if ((ipc = malloc(sizeof(ipc_channel_inproc_t))) == NULL)
+    return NULL;
+
+  IPC_EOK(pthread_mutex_lock(&registry_lock));
+
+  for (ring = registry; ring != NULL; ring = ring->next)
+    if (!strcmp(ring->name, name))
+      break;
+
+  if (ring == NULL && (ring = ring_create(name, unit_size)) != NULL)
+  {
+    ring->next = registry;
+    registry = ring;
+  }
+
+  // a ring of another unit size is the same mismatch as EPROTO of shm
+  if (ring != NULL && ring->unit_size != unit_size)
+    ring = NULL;
+
+  if (ring != NULL)
+    ring->ref_count++;
+
+  IPC_EOK(pthread_mutex_unlock(&registry_lock));
+
+  if (ring == NULL)
+    goto failure;
+
+  ipc->ring = ring;
+
+  ipc->api.push = push;
+  ipc->api.pop = pop;
+  ipc->api.destroy = destroy;
+  ipc->api.try_pop = try_pop;
+  ipc->api.bind = NULL;
+  ipc->api.gauges = NULL;
+
+  return (ipc_channel_api_t *) ipc;
+
+failure:
+  free(ipc);
+  return NULL;
+}
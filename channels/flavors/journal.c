@@ -0,0 +1,454 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "channels/psync/futex.h"
+
+#include "channels/channel.h"
+#include "flavors.h"
+
+#define VIRTUAL_PAGE_SIZE   4096
+#define HEADER_SIZE         VIRTUAL_PAGE_SIZE
+#define DEFAULT_CAPACITY    (256 * 1024 * 1024)
+#define DEFAULT_SYNC_EVERY  1024
+
+#define JOURNAL_MAGIC       0x4950434au // "IPCJ"
+#define JOURNAL_VERSION     3
+
+// The journal file is a header page followed by `capacity` bytes of records,
+// appended and never overwritten. Every holder keeps a shared flock on it,
+// the one which gets it exclusively is alone and initializes or recovers it.
+typedef struct
+{
+  uint32_t       magic;
+  uint32_t       version;
+  uint64_t       unit_size;
+  uint64_t       capacity;
+
+  // producers reserve records by moving `reserved` and publish each one
+  // on its own by its `state`, so a producer never waits for another;
+  // `durable` is the end of the records a group commit has flushed
+  atomic_ullong  reserved;
+  atomic_ullong  durable;
+
+  // the cursor shared by consumers, it is stored in the journal
+  // so consumers resume from it after a restart
+  atomic_ullong  read_offset;
+
+  // futex word bumped on every commit, consumers sleep on it
+  atomic_uint    seq;
+  atomic_uint    waiting_consumers;
+} ipc_journal_header_t;
+
+static_assert(sizeof(ipc_journal_header_t) <= HEADER_SIZE,
+              "Journal header must fit its page");
+
+typedef enum
+{
+  RECORD_FREE,         // not written yet, or being written right now
+  RECORD_COMMITTED,    // the unit is there
+  RECORD_SKIPPED,      // reserved by a producer which died, readers pass it
+} ipc_journal_record_state_t;
+
+// `state` is stored after the unit is copied, readers check it first
+typedef struct
+{
+  atomic_ullong  state;
+
+  __attribute__ ((aligned(alignof(max_align_t))))
+  char           unit[];
+} ipc_journal_record_t;
+
+typedef struct
+{
+  ipc_channel_api_t        api;
+  int                      fd;
+  ipc_journal_header_t   * header;
+  char                   * data;
+  size_t                   mapped_size;
+  size_t                   unit_size;
+  size_t                   record_size;
+  size_t                   capacity;
+
+  ipc_journal_sync_t       sync;
+  unsigned                 sync_every;
+  unsigned                 unsynced;
+
+  // a replaying consumer reads with a cursor of its own
+  bool                     replay;
+  uint64_t                 cursor;
+} ipc_channel_journal_t;
+
+static_assert(offsetof(ipc_channel_journal_t, api) == 0,
+              "Channel struct must has `api` the first field");
+
+// Records are laid back to back, so each one is rounded up to keep
+// the `state` word and the unit of the next one aligned
+static size_t record_size_of(size_t unit_size)
+{
+  size_t size = sizeof(ipc_journal_record_t) + unit_size;
+  return (size + alignof(ipc_journal_record_t) - 1) / alignof(ipc_journal_record_t) * alignof(ipc_journal_record_t);
+}
+
+static ipc_journal_record_t * record_at(ipc_channel_journal_t * ipc, uint64_t offset)
+{
+  return (ipc_journal_record_t *) &ipc->data[offset];
+}
+
+static unsigned record_state(ipc_channel_journal_t * ipc, uint64_t offset)
+{
+  return atomic_load_explicit(&record_at(ipc, offset)->state, memory_order_acquire);
+}
+
+static void store_max(atomic_ullong * word, uint64_t value)
+{
+  uint64_t current = atomic_load(word);
+
+  while (current < value && !atomic_compare_exchange_weak(word, &current, value))
+    ;
+}
+
+static int msync_range(void * from, size_t size)
+{
+  uintptr_t begin = (uintptr_t) from / VIRTUAL_PAGE_SIZE * VIRTUAL_PAGE_SIZE;
+  uintptr_t end = (uintptr_t) from + size;
+
+  return msync((void *) begin, end - begin, MS_SYNC);
+}
+
+// Records have to reach the disk before the header claiming them,
+// so a group commit is two barriers: the records, then `durable`;
+// `durable` stays put when a barrier fails
+static int group_commit(ipc_channel_journal_t * ipc)
+{
+  ipc_journal_header_t * header = ipc->header;
+
+  uint64_t from = atomic_load(&header->durable);
+  uint64_t reserved = atomic_load(&header->reserved);
+  uint64_t to = from;
+
+  // durable records are a prefix, it ends at a record still being written
+  while (to < reserved && to + ipc->record_size <= ipc->capacity &&
+         record_state(ipc, to) != RECORD_FREE)
+    to += ipc->record_size;
+
+  if (from >= to)
+    return 0;
+
+  switch (ipc->sync)
+  {
+    case IPC_JOURNAL_SYNC_NONE:
+      return 0;
+
+    case IPC_JOURNAL_SYNC_MSYNC:
+      if (msync_range(&ipc->data[from], to - from))
+        return errno;
+      break;
+
+    case IPC_JOURNAL_SYNC_FDATASYNC:
+      if (fdatasync(ipc->fd))
+        return errno;
+      break;
+  }
+
+  store_max(&header->durable, to);
+  return msync_range(header, sizeof(*header)) ? errno : 0;
+}
+
+static int push(void * self, const void * buffer)
+{
+  ipc_channel_journal_t * ipc = self;
+  ipc_journal_header_t * header = ipc->header;
+
+  uint64_t offset = atomic_load(&header->reserved);
+
+  // the journal never grows, a reservation stops at its end
+  do
+  {
+    if (offset + ipc->record_size > ipc->capacity)
+      return ENOSPC;
+  } while (!atomic_compare_exchange_weak(&header->reserved, &offset, offset + ipc->record_size));
+
+  ipc_journal_record_t * record = record_at(ipc, offset);
+
+  memcpy(record->unit, buffer, ipc->unit_size);
+  atomic_store_explicit(&record->state, RECORD_COMMITTED, memory_order_release);
+
+  atomic_fetch_add(&header->seq, 1);
+  if (atomic_load(&header->waiting_consumers) > 0)
+    ipc_futex_wake_all(&header->seq);
+
+  // the unit is readable either way, an error says it may not be durable
+  if (ipc->sync != IPC_JOURNAL_SYNC_NONE && ++ipc->unsynced >= ipc->sync_every)
+  {
+    ipc->unsynced = 0;
+    return group_commit(ipc);
+  }
+
+  return 0;
+}
+
+// Moves the cursor past the record at `offset`,
+// fails when another consumer has taken it in the meantime
+static bool advance(ipc_channel_journal_t * ipc, uint64_t offset)
+{
+  if (ipc->replay)
+  {
+    ipc->cursor = offset + ipc->record_size;
+    return true;
+  }
+
+  return atomic_compare_exchange_strong(&ipc->header->read_offset,
+                                        &offset,
+                                        offset + ipc->record_size);
+}
+
+// Readers go in the reservation order and wait at a record being written
+static bool try_pop(void * self, void * buffer)
+{
+  ipc_channel_journal_t * ipc = self;
+  ipc_journal_header_t * header = ipc->header;
+
+  for (;;)
+  {
+    uint64_t offset = ipc->replay ? ipc->cursor : atomic_load(&header->read_offset);
+
+    if (offset + ipc->record_size > ipc->capacity)
+      return false;
+
+    switch (record_state(ipc, offset))
+    {
+      case RECORD_FREE:
+        return false;
+
+      case RECORD_SKIPPED:
+        advance(ipc, offset);
+        break;
+
+      case RECORD_COMMITTED:
+        memcpy(buffer, record_at(ipc, offset)->unit, ipc->unit_size);
+        if (advance(ipc, offset))
+          return true;
+        break;
+    }
+  }
+}
+
+static void pop(void * self, void * buffer)
+{
+  ipc_channel_journal_t * ipc = self;
+  ipc_journal_header_t * header = ipc->header;
+
+  for (;;)
+  {
+    unsigned seq = atomic_load(&header->seq);
+
+    if (try_pop(ipc, buffer))
+      return;
+
+    // a commit after `seq` was read changes it, so the wait returns at once
+    atomic_fetch_add(&header->waiting_consumers, 1);
+    ipc_futex_wait(&header->seq, seq, NULL);
+    atomic_fetch_sub(&header->waiting_consumers, 1);
+  }
+}
+
+static void destroy(void * self)
+{
+  ipc_channel_journal_t * ipc = self;
+  if (ipc)
+  {
+    group_commit(ipc);
+
+    munmap(ipc->header, ipc->mapped_size);
+    flock(ipc->fd, LOCK_UN);
+    close(ipc->fd);
+    free(ipc);
+  }
+}
+
+// Attaching holds a lock on the first byte, apart from the holders' flock,
+// since flock(2) turns the exclusive lock of an attacher which was alone
+// into a shared one in two steps and another attacher could take it between
+static int attach_lock(int fd, short type)
+{
+  struct flock lock = { .l_type = type, .l_whence = SEEK_SET, .l_start = 0, .l_len = 1 };
+  return fcntl(fd, F_OFD_SETLKW, &lock);
+}
+
+static void journal_init(ipc_journal_header_t * header, size_t unit_size, size_t capacity)
+{
+  header->magic = JOURNAL_MAGIC;
+  header->version = JOURNAL_VERSION;
+  header->unit_size = unit_size;
+  header->capacity = capacity;
+
+  atomic_init(&header->reserved, 0);
+  atomic_init(&header->durable, 0);
+  atomic_init(&header->read_offset, 0);
+  atomic_init(&header->seq, 0);
+  atomic_init(&header->waiting_consumers, 0);
+}
+
+// Nobody else holds the journal: a record reserved but never committed
+// belongs to a producer which died, readers skip it from now on.
+// After a crash of the whole system only the durable records are trusted,
+// the ones past them are dropped and written again.
+// A journal written without syncs has nothing durable, its records
+// are kept as long as the page cache keeps them.
+static void journal_recover(ipc_channel_journal_t * ipc)
+{
+  ipc_journal_header_t * header = ipc->header;
+
+  uint64_t reserved = atomic_load(&header->reserved);
+  uint64_t durable = atomic_load(&header->durable);
+  uint64_t read_offset = atomic_load(&header->read_offset);
+
+  if (durable > 0 && reserved > durable)
+  {
+    for (uint64_t offset = durable; offset < reserved; offset += ipc->record_size)
+      atomic_store(&record_at(ipc, offset)->state, RECORD_FREE);
+
+    reserved = durable;
+  }
+
+  // readers never pass a free record, dead reservations lie past them
+  if (read_offset > reserved)
+    read_offset = reserved;
+
+  for (uint64_t offset = read_offset; offset < reserved; offset += ipc->record_size)
+  {
+    atomic_ullong * state = &record_at(ipc, offset)->state;
+
+    if (atomic_load(state) == RECORD_FREE)
+      atomic_store(state, RECORD_SKIPPED);
+  }
+
+  atomic_store(&header->reserved, reserved);
+  atomic_store(&header->read_offset, read_offset);
+  atomic_store(&header->waiting_consumers, 0);
+}
+
+ipc_channel_api_t * ipc_channel_journal_create(const char                  * path,
+                                               size_t                        unit_size,
+                                               const ipc_channel_options_t * opts)
+{
+  ipc_channel_journal_t * ipc = NULL;
+  ipc_journal_header_t header;
+  struct stat st;
+  bool alone = false;
+  void * mem = MAP_FAILED;
+  int fd = -1;
+
+  if (__builtin_popcount(unit_size) != 1)
+    goto failure;
+
+  if ((ipc = calloc(1, sizeof(ipc_channel_journal_t))) == NULL)
+    goto failure;
+
+  if ((fd = open(path, O_RDWR | O_CREAT, 0600)) == -1)
+    goto failure;
+
+  // the exclusive lock is taken only while attaching,
+  // pushes and pops never touch it
+  if (attach_lock(fd, F_WRLCK))
+    goto failure;
+
+  if (flock(fd, LOCK_EX | LOCK_NB) == 0)
+    alone = true;
+  else if (errno != EWOULDBLOCK || flock(fd, LOCK_SH))
+    goto failure;
+
+  if (fstat(fd, &st))
+    goto failure;
+
+  if (st.st_size == 0)
+  {
+    assert(alone);
+
+    size_t units = (opts->journal.capacity ? opts->journal.capacity : DEFAULT_CAPACITY) / unit_size;
+    size_t capacity = units * record_size_of(unit_size);
+    capacity = (capacity + VIRTUAL_PAGE_SIZE - 1) / VIRTUAL_PAGE_SIZE * VIRTUAL_PAGE_SIZE;
+
+    // the file is sparse, the records take disk space as they are appended
+    if (ftruncate(fd, HEADER_SIZE + capacity))
+      goto failure;
+
+    if ((mem = mmap(NULL, HEADER_SIZE + capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+      goto failure;
+
+    journal_init(mem, unit_size, capacity);
+    ipc->mapped_size = HEADER_SIZE + capacity;
+  }
+  else
+  {
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header))
+      goto failure;
+
+    if (header.magic != JOURNAL_MAGIC ||
+        header.version != JOURNAL_VERSION ||
+        header.unit_size != unit_size ||
+        (off_t) (HEADER_SIZE + header.capacity) != st.st_size)
+    {
+      errno = EPROTO;
+      goto failure;
+    }
+
+    if ((mem = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+      goto failure;
+
+    ipc->mapped_size = st.st_size;
+  }
+
+  ipc->fd = fd;
+  ipc->header = mem;
+  ipc->data = (char *) mem + HEADER_SIZE;
+  ipc->unit_size = unit_size;
+  ipc->record_size = record_size_of(unit_size);
+  ipc->capacity = ipc->header->capacity;
+
+  if (alone && st.st_size > 0)
+    journal_recover(ipc);
+
+  if (alone && flock(fd, LOCK_SH))
+    goto failure;
+
+  if (attach_lock(fd, F_UNLCK))
+    goto failure;
+
+  ipc->sync = opts->journal.sync;
+  ipc->sync_every = opts->journal.sync_every ? opts->journal.sync_every : DEFAULT_SYNC_EVERY;
+  ipc->unsynced = 0;
+
+  ipc->replay = opts->journal.replay;
+  ipc->cursor = 0;
+
+  ipc->api.push = push;
+  ipc->api.pop = pop;
+  ipc->api.destroy = destroy;
+  ipc->api.try_pop = try_pop;
+  ipc->api.bind = NULL;
+  ipc->api.gauges = NULL;
+
+  return (ipc_channel_api_t *) ipc;
+
+failure:
+  if (mem != MAP_FAILED)
+    munmap(mem, ipc->mapped_size);
+  if (fd != -1)
+    close(fd);
+  free(ipc);
+  return NULL;
+}
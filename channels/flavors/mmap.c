@@ -15,19 +15,22 @@
 
 #include "channels/psync/mutex.h"
 #include "channels/psync/cv.h"
+#include "channels/psync/shm.h"
 
 #include "channels/channel.h"
+#include "channels/waitset.h"
 
 #define VIRTUAL_PAGE_SIZE   4096
-#define MMAP_SIZE           (262144 * VIRTUAL_PAGE_SIZE)
-#define CAPACITY            (MMAP_SIZE - sizeof(ipc_channel_mmap_shared_t))
+#define RING_BYTES          (4096 * VIRTUAL_PAGE_SIZE)
+#define RING_MIN_UNITS      256
+
+// goes into the layout tag of the segment next to the unit size,
+// bumped whenever `ipc_channel_mmap_shared_t` changes
+#define MMAP_LAYOUT_VERSION 2
 
 typedef struct
 {
-  // These two atomics synchronize initialization and destruction
-  // of the shared memory
-  atomic_uint  init_spinlock;
-  atomic_uint  ref_count;
+  ipc_shm_header_t header;
 
   ipc_mutex_t  mutex;
   ipc_cv_t     cv_not_full;
@@ -35,6 +38,20 @@ typedef struct
   size_t       head;
   size_t       tail;
 
+  // sleepers on the condition variables, a side which sees
+  // no sleepers on the other side skips the notification;
+  // `woken_consumers` of the sleeping consumers have been signalled
+  // already, a push signals only when some sleeper hasn't been
+  unsigned     waiting_producers;
+  unsigned     waiting_consumers;
+  unsigned     woken_consumers;
+
+  // the wait-set a consumer has bound the ring to, producers
+  // re-attach whenever `waitset_generation` has changed
+  char         waitset[IPC_WAITSET_NAME_MAX];
+  unsigned     waitset_slot;
+  unsigned     waitset_generation;
+
   __attribute__ ((aligned(alignof(max_align_t))))
   char     data[];
 } ipc_channel_mmap_shared_t;
@@ -45,14 +62,35 @@ typedef struct
   const char                * name;
   ipc_channel_mmap_shared_t * shared;
   size_t                      unit_size;
+  size_t                      capacity;
+  size_t                      low_watermark;
+  ipc_waitset_t             * waitset;
+  unsigned                    waitset_generation;
+  uint64_t                    stalls;
 } ipc_channel_mmap_t;
 
 static_assert(offsetof(ipc_channel_mmap_t, api) == 0,
               "Channel struct must has `api` the first field");
 
+static size_t ring_capacity(size_t unit_size)
+{
+  size_t capacity = RING_BYTES;
+
+  if (capacity < RING_MIN_UNITS * unit_size)
+    capacity = RING_MIN_UNITS * unit_size;
+
+  return capacity - capacity % unit_size;
+}
+
+static size_t segment_size(size_t unit_size)
+{
+  size_t size = sizeof(ipc_channel_mmap_shared_t) + ring_capacity(unit_size);
+  return (size + VIRTUAL_PAGE_SIZE - 1) / VIRTUAL_PAGE_SIZE * VIRTUAL_PAGE_SIZE;
+}
+
 static size_t real_capacity(const ipc_channel_mmap_t * ipc)
 {
-  return CAPACITY - CAPACITY % ipc->unit_size;
+  return ipc->capacity;
 }
 
 static size_t next_index_index(const ipc_channel_mmap_t * ipc, size_t from_idx)
@@ -83,115 +121,235 @@ static bool is_full(const ipc_channel_mmap_t * ipc)
   return ipc->shared->head == next_tail;
 }
 
-static void push(void * self, const void * buffer)
+static size_t filled_units(const ipc_channel_mmap_t * ipc)
+{
+  size_t capacity = real_capacity(ipc);
+  size_t filled = (ipc->shared->tail + capacity - ipc->shared->head) % capacity;
+
+  return filled / ipc->unit_size;
+}
+
+static inline void copy_unit(void * dst, const void * src, size_t unit_size)
+{
+  // small units are copied inline with a constant size
+  switch (unit_size)
+  {
+    case 1:  memcpy(dst, src, 1);  break;
+    case 2:  memcpy(dst, src, 2);  break;
+    case 4:  memcpy(dst, src, 4);  break;
+    case 8:  memcpy(dst, src, 8);  break;
+    case 16: memcpy(dst, src, 16); break;
+    default: memcpy(dst, src, unit_size);
+  }
+}
+
+static void recover(ipc_channel_mmap_t * ipc)
+{
+  // head and tail move only after a unit is copied, so the ring
+  // is consistent, but the dead owner could have missed its notification
+  ipc_shm_reap(&ipc->shared->header);
+  ipc_cv_notify_all(&ipc->shared->cv_not_empty);
+  ipc_cv_notify_all(&ipc->shared->cv_not_full);
+  ipc->shared->woken_consumers = ipc->shared->waiting_consumers;
+}
+
+static void lock_shared(ipc_channel_mmap_t * ipc)
+{
+  if (ipc_mutex_lock(&ipc->shared->mutex) == EOWNERDEAD)
+    recover(ipc);
+}
+
+static void wait_shared(ipc_channel_mmap_t * ipc, ipc_cv_t * cv)
+{
+  if (ipc_cv_wait(cv, &ipc->shared->mutex) == EOWNERDEAD)
+    recover(ipc);
+}
+
+#define SHARED_CRITICAL_SECTION(ipc)           \
+  IPC_DEFER(lock_shared(ipc),                  \
+            ipc_mutex_unlock(&(ipc)->shared->mutex))
+
+static void raise_waitset(ipc_channel_mmap_t * ipc)
+{
+  ipc_channel_mmap_shared_t * shared = ipc->shared;
+
+  if (ipc->waitset_generation != shared->waitset_generation)
+  {
+    ipc_waitset_destroy(ipc->waitset);
+    ipc->waitset = shared->waitset[0] ? ipc_waitset_create(shared->waitset, IPC_WAITSET_FAIR) : NULL;
+    ipc->waitset_generation = shared->waitset_generation;
+  }
+
+  if (ipc->waitset)
+    ipc_waitset_raise(ipc->waitset, shared->waitset_slot);
+}
+
+static int push(void * self, const void * buffer)
 {
   ipc_channel_mmap_t * ipc = self;
 
-  IPC_CRITICAL_SECTION(&ipc->shared->mutex)
+  SHARED_CRITICAL_SECTION(ipc)
   {
-    size_t capacity = real_capacity(ipc);
+    if (is_full(ipc))
+      ipc->stalls++;
 
     while (is_full(ipc))
     {
-      ipc_cv_wait(&ipc->shared->cv_not_full, &ipc->shared->mutex);
+      ipc->shared->waiting_producers++;
+      wait_shared(ipc, &ipc->shared->cv_not_full);
+      ipc->shared->waiting_producers--;
     }
-    
-    memcpy(&ipc->shared->data[ipc->shared->tail], buffer, ipc->unit_size);
+
+    copy_unit(&ipc->shared->data[ipc->shared->tail], buffer, ipc->unit_size);
     ipc->shared->tail = next_index_tail(ipc);
 
-    ipc_cv_notify_one(&ipc->shared->cv_not_empty);
+    // a sleeper is signalled once, the pushes until it runs
+    // signal nobody unless another consumer has fallen asleep
+    if (ipc->shared->waiting_consumers > ipc->shared->woken_consumers)
+    {
+      ipc->shared->woken_consumers++;
+      ipc_cv_notify_one(&ipc->shared->cv_not_empty);
+    }
+
+    raise_waitset(ipc);
+  }
+
+  return 0;
+}
+
+// Takes the unit at the head of a non-empty ring, the caller holds the mutex
+static void take_unit(ipc_channel_mmap_t * ipc, void * buffer)
+{
+  copy_unit(buffer, &ipc->shared->data[ipc->shared->head], ipc->unit_size);
+  ipc->shared->head = next_index_head(ipc);
+
+  // a producer sleeping on a full ring is woken once
+  // there is a worthwhile room for it
+  if (ipc->shared->waiting_producers > 0 &&
+      filled_units(ipc) <= ipc->low_watermark)
+  {
+    ipc_cv_notify_one(&ipc->shared->cv_not_full);
   }
 }
 
 static void pop(void * self, void * buffer)
 {
   ipc_channel_mmap_t * ipc = self;
-  size_t capacity = real_capacity(ipc);
 
-  IPC_CRITICAL_SECTION(&ipc->shared->mutex)
+  SHARED_CRITICAL_SECTION(ipc)
   {
     while (is_empty(ipc))
     {
-      ipc_cv_wait(&ipc->shared->cv_not_empty, &ipc->shared->mutex);
+      ipc->shared->waiting_consumers++;
+      wait_shared(ipc, &ipc->shared->cv_not_empty);
+      ipc->shared->waiting_consumers--;
+
+      // a spurious wake up takes a signal of another sleeper,
+      // which only makes the next push signal again
+      if (ipc->shared->woken_consumers > 0)
+        ipc->shared->woken_consumers--;
     }
-    
-    memcpy(buffer, &ipc->shared->data[ipc->shared->head], ipc->unit_size);
-    ipc->shared->head = next_index_head(ipc);
 
-    ipc_cv_notify_one(&ipc->shared->cv_not_full);
+    take_unit(ipc, buffer);
   }
 }
 
-static void mmap_shared_destroy(ipc_channel_mmap_shared_t * shared);
-static void destroy(void * self)
+static bool try_pop(void * self, void * buffer)
 {
   ipc_channel_mmap_t * ipc = self;
-  if (ipc)
+  bool popped = false;
+
+  SHARED_CRITICAL_SECTION(ipc)
   {
-    mmap_shared_destroy(ipc->shared);
-    shm_unlink(ipc->name);
-    free(ipc);
+    if (!is_empty(ipc))
+    {
+      take_unit(ipc, buffer);
+      popped = true;
+    }
   }
+
+  return popped;
 }
 
-static void * execute_mmap(const char * name)
+// Both directions are the same ring, a free slot is a credit
+static int gauges(void * self, ipc_channel_gauges_t * gauges)
 {
-  int shm = shm_open(name, O_CREAT|O_RDWR, 0600);
-  void * mem = NULL;
-
-  if (shm < 0) return NULL;
+  ipc_channel_mmap_t * ipc = self;
 
-  if (ftruncate(shm, MMAP_SIZE))
+  SHARED_CRITICAL_SECTION(ipc)
   {
-    shm_unlink(name);
-    goto exit;
-  }
+    size_t filled = filled_units(ipc);
 
-  mem = mmap(NULL, MMAP_SIZE, PROT_WRITE|PROT_READ, MAP_SHARED, shm, 0);
+    gauges->outbound_bytes = filled * ipc->unit_size;
+    gauges->inbound_bytes = filled * ipc->unit_size;
+    gauges->credits = real_capacity(ipc) / ipc->unit_size - 1 - filled;
+    gauges->stalls = ipc->stalls;
+  }
 
-exit:
-  close(shm);
-  return mem;
+  return 0;
 }
 
-static int mmap_shared_create(void * shared_mem)
+static int bind_waitset(void * self, const char * waitset, unsigned slot)
 {
-  int ret = 0;
-  ipc_channel_mmap_shared_t * shared = shared_mem;
+  ipc_channel_mmap_t * ipc = self;
+
+  if (waitset && strlen(waitset) >= IPC_WAITSET_NAME_MAX)
+    return ENAMETOOLONG;
 
-  unsigned exp = 0;
-  while (!atomic_compare_exchange_weak(&shared->init_spinlock, &exp, 1))
+  SHARED_CRITICAL_SECTION(ipc)
   {
-    sched_yield();
+    strcpy(ipc->shared->waitset, waitset ? waitset : "");
+    ipc->shared->waitset_slot = slot;
+    ipc->shared->waitset_generation++;
   }
 
-  if (atomic_fetch_add_explicit(&shared->ref_count, 1, memory_order_acq_rel) > 0)
+  return 0;
+}
+
+static void mmap_shared_destroy(void * shared_mem, void * arg);
+static void destroy(void * self)
+{
+  ipc_channel_mmap_t * ipc = self;
+  if (ipc)
   {
-    // the shared memory is already initialized
-    goto exit;
+    ipc_waitset_destroy(ipc->waitset);
+    ipc_shm_detach(ipc->name, ipc->shared, mmap_shared_destroy, ipc);
+    free(ipc);
   }
+}
+
+static int mmap_shared_create(void * shared_mem, void * arg)
+{
+  int ret = 0;
+  ipc_channel_mmap_shared_t * shared = shared_mem;
 
   if ((ret = ipc_mutex_init(&shared->mutex)))
-    goto exit;
+    return ret;
 
   if ((ret = ipc_cv_init(&shared->cv_not_empty)))
-    goto exit;
+    return ret;
 
   if ((ret = ipc_cv_init(&shared->cv_not_full)))
-    goto exit;
+    return ret;
 
   shared->head = 0;
   shared->tail = 0;
+  shared->waiting_producers = 0;
+  shared->waiting_consumers = 0;
+  shared->woken_consumers = 0;
+  shared->waitset[0] = '\0';
+  shared->waitset_slot = 0;
+  shared->waitset_generation = 0;
 
-exit:
-  shared->init_spinlock = 0;
   return ret;
 }
 
-ipc_channel_api_t * ipc_channel_mmap_create(const char * name, size_t unit_size)
+ipc_channel_api_t * ipc_channel_mmap_create(const char                  * name,
+                                            size_t                        unit_size,
+                                            const ipc_channel_options_t * opts)
 {
   ipc_channel_mmap_t * ipc = NULL;
-  void * shared_mem = (void *) -1;
+  void * shared_mem = NULL;
 
   if (__builtin_popcount(unit_size) != 1)
     goto failure;
@@ -199,45 +357,49 @@ ipc_channel_api_t * ipc_channel_mmap_create(const char * name, size_t unit_size)
   if ((ipc = malloc(sizeof(ipc_channel_mmap_t))) == NULL)
     goto failure;
 
-  if ((shared_mem = execute_mmap(name)) == (void *) -1)
-    goto failure;
-
-  if (mmap_shared_create(shared_mem))
+  if (ipc_shm_attach(name,
+                     segment_size(unit_size),
+                     (uint64_t) MMAP_LAYOUT_VERSION << 32 | unit_size,
+                     mmap_shared_create,
+                     ipc,
+                     &shared_mem))
     goto failure;
 
   ipc->name = name; // ISSUE: implicit static lifetime assumption
 
   ipc->shared = shared_mem;
   ipc->unit_size = unit_size;
+  ipc->capacity = ring_capacity(unit_size);
+  ipc->waitset = NULL;
+  ipc->waitset_generation = 0;
+  ipc->stalls = 0;
+
+  // the room left below the watermark has to be reachable
+  // by popping from a full ring
+  size_t units = ipc->capacity / unit_size;
+  ipc->low_watermark = opts->mmap.low_watermark ? opts->mmap.low_watermark : units / 2;
+  if (ipc->low_watermark > units - 1)
+    ipc->low_watermark = units - 1;
   ipc->api.push = push;
   ipc->api.pop = pop;
   ipc->api.destroy = destroy;
+  ipc->api.try_pop = try_pop;
+  ipc->api.bind = bind_waitset;
+  ipc->api.gauges = gauges;
 
   return (ipc_channel_api_t *) ipc;
 
 failure:
-  if (shared_mem != (void *) -1) munmap(shared_mem, MMAP_SIZE);
   free(ipc);
   return NULL;
 }
 
-static void mmap_shared_destroy(ipc_channel_mmap_shared_t * shared)
+static void mmap_shared_destroy(void * shared_mem, void * arg)
 {
+  ipc_channel_mmap_shared_t * shared = shared_mem;
   assert(shared);
-  
-  size_t prev_holders = atomic_fetch_sub_explicit(&shared->ref_count,
-                                                  1,
-                                                  memory_order_acquire);
-
-  if (prev_holders == 1)
-  {
-    // the last holder of the shared memory
-    // must release collected there resources
-    
-    ipc_mutex_destroy(&shared->mutex);
-    ipc_cv_destroy(&shared->cv_not_empty);
-    ipc_cv_destroy(&shared->cv_not_full);
-  }
 
-  munmap(shared, MMAP_SIZE);
+  ipc_mutex_destroy(&shared->mutex);
+  ipc_cv_destroy(&shared->cv_not_empty);
+  ipc_cv_destroy(&shared->cv_not_full);
 }
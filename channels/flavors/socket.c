@@ -1,10 +1,17 @@
 #include <assert.h>
+#include <errno.h>
+#include <linux/sockios.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
 
 #include "channels/channel.h"
+#include "flavors.h"
+#include "frame.h"
 
 #define BACKLOG 512
 
@@ -15,23 +22,143 @@ typedef struct
   size_t              unit_size;
   int                 sockfd;
   int                 conn_sockfd;
+
+  // flow control, off when `window` is 0: the producer spends a credit
+  // per unit, the consumer grants them back in CREDIT frames
+  // on the reverse direction of the stream, so a side with credits
+  // either pushes or pops, `producing`/`consuming` say which
+  unsigned            window;
+  unsigned            grant_every;
+  unsigned            credits;       // producer side
+  unsigned            ungranted;     // consumer side, popped since the last grant
+  bool                producing;
+  bool                consuming;
+  uint64_t            stalls;
 } ipc_channel_socket_t;
 
 static_assert(offsetof(ipc_channel_socket_t, api) == 0,
               "Channel struct must has `api` the first field");
 
-static void push(void * self, const void * buffer)
+// Takes a CREDIT frame off the stream, waits for one when `wait`
+static int take_credit(ipc_channel_socket_t * ipc, bool wait)
+{
+  ipc_frame_t frame;
+  int fd = -1;
+  int ret = 0;
+
+  if ((ret = ipc_frame_recv(ipc->conn_sockfd, &frame, &fd, !wait)))
+    return ret;
+
+  if (fd != -1)
+    close(fd);
+
+  if (frame.kind != IPC_FRAME_CREDIT || frame.size > ipc->window - ipc->credits)
+    return EPROTO;
+
+  ipc->credits += frame.size;
+  return 0;
+}
+
+// Units larger than the socket buffer go through in parts
+static int push(void * self, const void * buffer)
 {
   ipc_channel_socket_t * ipc = self;
-  int ret = send(ipc->conn_sockfd, buffer, ipc->unit_size, 0);
-  assert(ret > 0);
+  const char * bytes = buffer;
+
+  if (ipc->window > 0)
+  {
+    // the grants of our own pops share the stream with the units
+    if (ipc->consuming)
+      return EINVAL;
+
+    ipc->producing = true;
+
+    if (ipc->credits == 0)
+    {
+      ipc->stalls++;
+
+      // ECONNRESET once the consumer is gone, EPROTO on a stray frame
+      while (ipc->credits == 0)
+      {
+        int ret = take_credit(ipc, true);
+        if (ret != 0)
+          return ret;
+      }
+    }
+
+    ipc->credits--;
+  }
+
+  // a consumer gone makes it EPIPE or ECONNRESET instead of a SIGPIPE
+  for (size_t sent = 0; sent < ipc->unit_size; )
+  {
+    ssize_t ret = send(ipc->conn_sockfd, bytes + sent, ipc->unit_size - sent, MSG_NOSIGNAL);
+    if (ret == -1 && errno == EINTR)
+      continue;
+    if (ret == -1)
+      return errno;
+    sent += ret;
+  }
+
+  return 0;
 }
 
 static void pop(void * self, void * buffer)
 {
   ipc_channel_socket_t * ipc = self;
-  int ret = recv(ipc->conn_sockfd, buffer, ipc->unit_size, 0);
-  assert(ret > 0);
+
+  // a pop can't fail, and the peer's grants would read as units
+  if (ipc->window > 0 && ipc->producing)
+  {
+    printf("error[socket]: %s pops on a credited side which pushes\n", ipc->sock_path);
+    fflush(stdout);
+    abort();
+  }
+
+  ssize_t ret = recv(ipc->conn_sockfd, buffer, ipc->unit_size, MSG_WAITALL);
+  assert(ret == ipc->unit_size);
+
+  ipc->consuming = true;
+
+  if (ipc->window > 0 && ++ipc->ungranted >= ipc->grant_every)
+  {
+    ipc_frame_t frame = { .kind = IPC_FRAME_CREDIT, .size = ipc->ungranted };
+    ipc->ungranted = 0;
+
+    // a producer done with its last units may have closed already,
+    // it needs no more credits then
+    ipc_frame_send(ipc->conn_sockfd, &frame, -1);
+  }
+}
+
+// Outbound bytes are what the kernel charges for the unread skbs
+// of the stream (SIOCOUTQ), so a bit more than the payload itself
+static int gauges(void * self, ipc_channel_gauges_t * gauges)
+{
+  ipc_channel_socket_t * ipc = self;
+  int outq = 0, inq = 0;
+  int ret = 0;
+
+  // only a producer reads CREDIT frames, a consumer's stream holds units,
+  // and a side which hasn't pushed yet can't tell which one it is
+  if (ipc->window > 0 && ipc->producing)
+  {
+    while ((ret = take_credit(ipc, false)) == 0)
+      ;
+
+    if (ret != EAGAIN)
+      return ret;
+  }
+
+  if (ioctl(ipc->conn_sockfd, SIOCOUTQ, &outq) == -1 ||
+      ioctl(ipc->conn_sockfd, SIOCINQ, &inq) == -1)
+    return errno;
+
+  gauges->outbound_bytes = outq;
+  gauges->inbound_bytes = inq;
+  gauges->credits = ipc->window > 0 && ipc->producing ? ipc->credits : SIZE_MAX;
+  gauges->stalls = ipc->stalls;
+  return 0;
 }
 
 static void destroy(void * self)
@@ -46,7 +173,7 @@ static void destroy(void * self)
   }
 }
 
-static int domain_sockpair_connect(const char * sock_path, int (*sockpair)[2])
+int ipc_domain_sockpair_connect(const char * sock_path, int (*sockpair)[2])
 {
   struct sockaddr_un addr;
   struct sockaddr * saddr = (struct sockaddr *) &addr;
@@ -95,7 +222,9 @@ failure:
   return ret;
 }
 
-ipc_channel_api_t * ipc_channel_socket_create(const char * sock_path, size_t unit_size)
+ipc_channel_api_t * ipc_channel_socket_create(const char                  * sock_path,
+                                              size_t                        unit_size,
+                                              const ipc_channel_options_t * opts)
 {
   ipc_channel_socket_t * ipc = NULL;
   int sockpair[2] = { -1, -1 };
@@ -103,7 +232,7 @@ ipc_channel_api_t * ipc_channel_socket_create(const char * sock_path, size_t uni
   if ((ipc = malloc(sizeof(ipc_channel_socket_t))) == NULL)
     goto failure;
 
-  if (domain_sockpair_connect(sock_path, &sockpair) != 0)
+  if (ipc_domain_sockpair_connect(sock_path, &sockpair) != 0)
     goto failure;
 
   ipc->sockfd = sockpair[0];
@@ -111,9 +240,23 @@ ipc_channel_api_t * ipc_channel_socket_create(const char * sock_path, size_t uni
   ipc->sock_path = sock_path; // ISSUE: static lifetime assumption
   ipc->unit_size = unit_size;
 
+  ipc->window = opts ? opts->socket.credits : 0;
+  ipc->grant_every = opts && opts->socket.grant_every ? opts->socket.grant_every : ipc->window / 4;
+  if (ipc->grant_every == 0 || ipc->grant_every > ipc->window)
+    ipc->grant_every = ipc->window ? ipc->window : 1;
+
+  ipc->credits = ipc->window;
+  ipc->ungranted = 0;
+  ipc->producing = false;
+  ipc->consuming = false;
+  ipc->stalls = 0;
+
   ipc->api.push = push;
   ipc->api.pop = pop;
   ipc->api.destroy = destroy;
+  ipc->api.try_pop = NULL;
+  ipc->api.bind = NULL;
+  ipc->api.gauges = gauges;
 
   return (ipc_channel_api_t *) ipc;
 
@@ -0,0 +1,222 @@
+#include <assert.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "channels/channel.h"
+#include "flavors.h"
+
+#define BACKLOG             512
+#define ADDRESS_MAX         256
+#define CONNECT_RETRIES     1000
+#define CONNECT_RETRY_NS    (1000 * 1000)
+
+typedef struct
+{
+  ipc_channel_api_t   api;
+  size_t              unit_size;
+  int                 conn_sockfd;
+} ipc_channel_tcp_t;
+
+static_assert(offsetof(ipc_channel_tcp_t, api) == 0,
+              "Channel struct must has `api` the first field");
+
+// A stream hands out any part of a unit, large units over TCP
+// are split into segments, so both sides loop over the whole unit
+static int push(void * self, const void * buffer)
+{
+  ipc_channel_tcp_t * ipc = self;
+  const char * bytes = buffer;
+
+  for (size_t sent = 0; sent < ipc->unit_size; )
+  {
+    ssize_t ret = send(ipc->conn_sockfd, bytes + sent, ipc->unit_size - sent, 0);
+    assert(ret > 0);
+    sent += ret;
+  }
+
+  return 0;
+}
+
+static void pop(void * self, void * buffer)
+{
+  ipc_channel_tcp_t * ipc = self;
+  char * bytes = buffer;
+
+  for (size_t received = 0; received < ipc->unit_size; )
+  {
+    ssize_t ret = recv(ipc->conn_sockfd, bytes + received, ipc->unit_size - received, 0);
+    assert(ret > 0);
+    received += ret;
+  }
+
+  // the kernel drops back to delayed acks on its own,
+  // quick acks have to be asked for again after every read
+  setsockopt(ipc->conn_sockfd, IPPROTO_TCP, TCP_QUICKACK, &(int) {1}, sizeof(int));
+}
+
+static void destroy(void * self)
+{
+  if (self)
+  {
+    ipc_channel_tcp_t * ipc = self;
+
+    close(ipc->conn_sockfd);
+    free(ipc);
+  }
+}
+
+// `address` is "host:port", e.g. "127.0.0.1:38314"
+static int resolve(const char * address, struct addrinfo ** info)
+{
+  char host[ADDRESS_MAX];
+  const char * colon = strrchr(address, ':');
+
+  if (colon == NULL || colon - address >= ADDRESS_MAX)
+    return EINVAL;
+
+  memcpy(host, address, colon - address);
+  host[colon - address] = '\0';
+
+  struct addrinfo hints =
+  {
+    .ai_family   = AF_UNSPEC,
+    .ai_socktype = SOCK_STREAM,
+    .ai_flags    = AI_NUMERICSERV,
+  };
+
+  return getaddrinfo(host, colon + 1, &hints, info) ? EINVAL : 0;
+}
+
+static int tune(int sockfd, const ipc_channel_options_t * opts)
+{
+  if (setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &(int) {1}, sizeof(int)))
+    return errno;
+
+  if (setsockopt(sockfd, IPPROTO_TCP, TCP_QUICKACK, &(int) {1}, sizeof(int)))
+    return errno;
+
+  if (opts->tcp.sndbuf &&
+      setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, &opts->tcp.sndbuf, sizeof(int)))
+    return errno;
+
+  if (opts->tcp.rcvbuf &&
+      setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &opts->tcp.rcvbuf, sizeof(int)))
+    return errno;
+
+  // busy polling needs CAP_NET_ADMIN to go above net.core.busy_read
+  if (opts->tcp.busy_poll &&
+      setsockopt(sockfd, SOL_SOCKET, SO_BUSY_POLL, &opts->tcp.busy_poll, sizeof(int)))
+    return errno;
+
+  return 0;
+}
+
+// Binds `info` and accepts a peer, or connects to it when bound already.
+// The peer may have bound the port but not listen on it yet,
+// a refused connection is retried for a while.
+static int tcp_connect(struct addrinfo * info, const ipc_channel_options_t * opts)
+{
+  int sockfd = -1, connfd = -1;
+
+  if ((sockfd = socket(info->ai_family, SOCK_STREAM, 0)) < 0)
+    goto failure;
+
+  // a previous run leaves the port in TIME_WAIT, which is also why
+  // both peers may bind it, only one of them gets to listen on it
+  if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &(int) {1}, sizeof(int)))
+    goto failure;
+
+  // buffer sizes are set before the handshake, which negotiates the window,
+  // an accepted socket inherits them
+  if ((errno = tune(sockfd, opts)))
+    goto failure;
+
+  if (bind(sockfd, info->ai_addr, info->ai_addrlen) == 0 && listen(sockfd, BACKLOG) == 0)
+  {
+    // server path
+    if ((connfd = accept(sockfd, NULL, NULL)) < 0)
+      goto failure;
+
+    // but TCP_QUICKACK, which is not inherited
+    if ((errno = tune(connfd, opts)))
+      goto failure;
+
+    close(sockfd);
+    sockfd = -1;
+  }
+  else
+  {
+    // client path
+    if (errno != EADDRINUSE)
+      goto failure;
+
+    close(sockfd);
+    sockfd = -1;
+
+    if ((connfd = socket(info->ai_family, SOCK_STREAM, 0)) < 0)
+      goto failure;
+
+    if ((errno = tune(connfd, opts)))
+      goto failure;
+
+    for (int retry = 0; connect(connfd, info->ai_addr, info->ai_addrlen) < 0; retry++)
+    {
+      if (errno != ECONNREFUSED || retry == CONNECT_RETRIES)
+        goto failure;
+
+      nanosleep(&(struct timespec) { .tv_nsec = CONNECT_RETRY_NS }, NULL);
+    }
+  }
+
+  return connfd;
+
+failure:
+  close(connfd);
+  close(sockfd);
+  return -1;
+}
+
+ipc_channel_api_t * ipc_channel_tcp_create(const char                  * address,
+                                           size_t                        unit_size,
+                                           const ipc_channel_options_t * opts)
+{
+  ipc_channel_tcp_t * ipc = NULL;
+  struct addrinfo * info = NULL;
+  int connfd = -1;
+
+  if ((ipc = malloc(sizeof(ipc_channel_tcp_t))) == NULL)
+    goto failure;
+
+  if (resolve(address, &info) != 0)
+    goto failure;
+
+  if ((connfd = tcp_connect(info, opts)) < 0)
+    goto failure;
+
+  freeaddrinfo(info);
+
+  ipc->conn_sockfd = connfd;
+  ipc->unit_size = unit_size;
+
+  ipc->api.push = push;
+  ipc->api.pop = pop;
+  ipc->api.destroy = destroy;
+  ipc->api.try_pop = NULL;
+  ipc->api.bind = NULL;
+  ipc->api.gauges = NULL;
+
+  return (ipc_channel_api_t *) ipc;
+
+failure:
+  if (info)
+    freeaddrinfo(info);
+  free(ipc);
+  return NULL;
+}
@@ -0,0 +1,634 @@
+#include <assert.h>
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "channels/channel.h"
+#include "flavors.h"
+
+#define DEFAULT_DEPTH       64
+#define RX_CHUNK_SIZE       16384
+#define SQ_THREAD_IDLE_MS   1000
+
+// The registered socket is the only fixed file of a ring
+#define FIXED_SOCKET        0
+
+typedef struct
+{
+  int                   fd;
+  bool                  sqpoll;
+
+  void                * sq_mem;
+  size_t                sq_mem_size;
+  void                * cq_mem;
+  size_t                cq_mem_size;
+  struct io_uring_sqe * sqes;
+  size_t                sqes_size;
+
+  atomic_uint         * sq_head;
+  atomic_uint         * sq_tail;
+  atomic_uint         * sq_flags;
+  unsigned            * sq_array;
+  unsigned              sq_mask;
+  unsigned              sq_pending;
+
+  atomic_uint         * cq_head;
+  atomic_uint         * cq_tail;
+  struct io_uring_cqe * cqes;
+  unsigned              cq_mask;
+} uring_t;
+
+// Units are copied into `depth` slots of the registered buffer and
+// one send at a time is kept in flight, covering all the slots staged
+// since the previous one: io_uring parks a send on a full socket buffer
+// and goes on with the next one, so two sends of a stream in flight
+// could reorder it. A range wrapping around the end of the buffer
+// goes as two sends linked together.
+// Units staged behind a send in flight go out once it completes,
+// which the next push or destroy notices.
+typedef struct
+{
+  uring_t    ring;
+  char     * buffer;
+  size_t     buffer_size;
+  unsigned   depth;
+  size_t     staged;       // copied into the buffer
+  size_t     submitted;    // handed to the kernel
+  size_t     completed;    // sent, their slots are free
+  unsigned   in_flight;    // send entries not reaped yet
+  bool       fixed_send;
+} uring_tx_t;
+
+// The registered buffer is split into `depth` chunks, the kernel
+// fills them one after another with a single read kept in flight
+// (a stream has to be read in order), while pop drains the filled ones.
+typedef struct
+{
+  uring_t    ring;
+  char     * buffer;
+  size_t     buffer_size;
+  size_t     chunk_size;
+  unsigned   depth;
+  int      * lengths;
+  unsigned   current;
+  size_t     offset;
+  int        armed;
+} uring_rx_t;
+
+#define RX_NOT_ARMED (-1)
+
+typedef struct
+{
+  ipc_channel_api_t   api;
+  const char        * sock_path;
+  size_t              unit_size;
+  int                 sockfd;
+  int                 conn_sockfd;
+  unsigned            depth;
+  bool                sqpoll;
+  uring_tx_t        * tx;
+  uring_rx_t        * rx;
+} ipc_channel_uring_t;
+
+static_assert(offsetof(ipc_channel_uring_t, api) == 0,
+              "Channel struct must has `api` the first field");
+
+//**************************//
+//    raw io_uring rings    //
+//**************************//
+
+static int uring_enter(uring_t * ring, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+  int ret;
+
+  do
+  {
+    ret = syscall(__NR_io_uring_enter, ring->fd, to_submit, min_complete, flags, NULL, 0);
+  } while (ret < 0 && errno == EINTR);
+
+  return ret;
+}
+
+static int uring_register(uring_t * ring, unsigned opcode, const void * arg, unsigned nr_args)
+{
+  return syscall(__NR_io_uring_register, ring->fd, opcode, arg, nr_args) < 0 ? errno : 0;
+}
+
+static void * map_ring(int fd, size_t size, off_t offset)
+{
+  return mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, offset);
+}
+
+static void uring_close(uring_t * ring)
+{
+  if (ring->sqes != NULL && ring->sqes != MAP_FAILED)
+    munmap(ring->sqes, ring->sqes_size);
+
+  if (ring->cq_mem != NULL && ring->cq_mem != MAP_FAILED && ring->cq_mem != ring->sq_mem)
+    munmap(ring->cq_mem, ring->cq_mem_size);
+
+  if (ring->sq_mem != NULL && ring->sq_mem != MAP_FAILED)
+    munmap(ring->sq_mem, ring->sq_mem_size);
+
+  close(ring->fd);
+}
+
+// A ring set up with `attach` shares the polling thread of that one
+static int uring_setup(uring_t * ring, unsigned entries, bool sqpoll, const uring_t * attach, int sockfd)
+{
+  struct io_uring_params params;
+  int ret = 0;
+
+  memset(ring, 0, sizeof(uring_t));
+  memset(&params, 0, sizeof(params));
+
+  if (sqpoll)
+  {
+    params.flags |= IORING_SETUP_SQPOLL;
+    params.sq_thread_idle = SQ_THREAD_IDLE_MS;
+
+    if (attach)
+    {
+      params.flags |= IORING_SETUP_ATTACH_WQ;
+      params.wq_fd = attach->fd;
+    }
+  }
+
+  if ((ring->fd = syscall(__NR_io_uring_setup, entries, &params)) < 0)
+    return errno;
+
+  ring->sqpoll = sqpoll;
+  ring->sq_mem_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cq_mem_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+  {
+    if (ring->cq_mem_size > ring->sq_mem_size)
+      ring->sq_mem_size = ring->cq_mem_size;
+
+    ring->cq_mem_size = ring->sq_mem_size;
+  }
+
+  if ((ring->sq_mem = map_ring(ring->fd, ring->sq_mem_size, IORING_OFF_SQ_RING)) == MAP_FAILED)
+    goto failure;
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+    ring->cq_mem = ring->sq_mem;
+  else if ((ring->cq_mem = map_ring(ring->fd, ring->cq_mem_size, IORING_OFF_CQ_RING)) == MAP_FAILED)
+    goto failure;
+
+  if ((ring->sqes = map_ring(ring->fd, ring->sqes_size, IORING_OFF_SQES)) == MAP_FAILED)
+    goto failure;
+
+  char * sq = ring->sq_mem;
+  ring->sq_head  = (atomic_uint *) (sq + params.sq_off.head);
+  ring->sq_tail  = (atomic_uint *) (sq + params.sq_off.tail);
+  ring->sq_flags = (atomic_uint *) (sq + params.sq_off.flags);
+  ring->sq_array = (unsigned *) (sq + params.sq_off.array);
+  ring->sq_mask  = *(unsigned *) (sq + params.sq_off.ring_mask);
+  ring->sq_pending = *(unsigned *) (sq + params.sq_off.tail);
+
+  char * cq = ring->cq_mem;
+  ring->cq_head = (atomic_uint *) (cq + params.cq_off.head);
+  ring->cq_tail = (atomic_uint *) (cq + params.cq_off.tail);
+  ring->cqes    = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+  ring->cq_mask = *(unsigned *) (cq + params.cq_off.ring_mask);
+
+  // fixed files spare the per-operation file lookup and refcounting
+  if ((ret = uring_register(ring, IORING_REGISTER_FILES, &sockfd, 1)))
+    goto exit;
+
+  return 0;
+
+failure:
+  ret = errno;
+exit:
+  uring_close(ring);
+  return ret;
+}
+
+static int uring_register_buffer(uring_t * ring, void * buffer, size_t size)
+{
+  struct iovec iov = { .iov_base = buffer, .iov_len = size };
+  return uring_register(ring, IORING_REGISTER_BUFFERS, &iov, 1);
+}
+
+static struct io_uring_sqe * uring_get_sqe(uring_t * ring)
+{
+  // the caller never keeps more entries in flight than the ring has,
+  // so there is always a free entry
+  unsigned idx = ring->sq_pending++ & ring->sq_mask;
+  struct io_uring_sqe * sqe = &ring->sqes[idx];
+
+  ring->sq_array[idx] = idx;
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  return sqe;
+}
+
+// Publishes the entries prepared since the last call
+static void uring_submit(uring_t * ring)
+{
+  unsigned tail = atomic_load_explicit(ring->sq_tail, memory_order_relaxed);
+  unsigned count = ring->sq_pending - tail;
+
+  atomic_store_explicit(ring->sq_tail, ring->sq_pending, memory_order_release);
+
+  if (ring->sqpoll)
+  {
+    // the kernel thread picks the entries up by itself,
+    // unless it went to sleep after being idle
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (atomic_load_explicit(ring->sq_flags, memory_order_relaxed) & IORING_SQ_NEED_WAKEUP)
+      uring_enter(ring, 0, 0, IORING_ENTER_SQ_WAKEUP);
+
+    return;
+  }
+
+  int ret = uring_enter(ring, count, 0, 0);
+  assert(ret == count);
+}
+
+static bool uring_peek_cqe(uring_t * ring, struct io_uring_cqe * cqe)
+{
+  unsigned head = atomic_load_explicit(ring->cq_head, memory_order_relaxed);
+  unsigned tail = atomic_load_explicit(ring->cq_tail, memory_order_acquire);
+
+  if (head == tail)
+    return false;
+
+  *cqe = ring->cqes[head & ring->cq_mask];
+  atomic_store_explicit(ring->cq_head, head + 1, memory_order_release);
+  return true;
+}
+
+static void uring_wait_cqe(uring_t * ring, struct io_uring_cqe * cqe)
+{
+  while (!uring_peek_cqe(ring, cqe))
+  {
+    int ret = uring_enter(ring, 0, 1, IORING_ENTER_GETEVENTS);
+    assert(ret >= 0);
+  }
+}
+
+static void * alloc_buffer(size_t size)
+{
+  void * buffer = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  return buffer == MAP_FAILED ? NULL : buffer;
+}
+
+//**************************//
+//    send side             //
+//**************************//
+
+static void tx_prep_send(uring_tx_t * tx, const void * data, size_t size, bool link)
+{
+  struct io_uring_sqe * sqe = uring_get_sqe(&tx->ring);
+
+  sqe->opcode = IORING_OP_SEND;
+  sqe->fd = FIXED_SOCKET;
+  sqe->flags = IOSQE_FIXED_FILE | (link ? IOSQE_IO_LINK : 0);
+  sqe->addr = (unsigned long) data;
+  sqe->len = size;
+  sqe->msg_flags = MSG_WAITALL;
+
+  if (tx->fixed_send)
+  {
+    sqe->ioprio = IORING_RECVSEND_FIXED_BUF;
+    sqe->buf_index = 0;
+  }
+}
+
+// Registered buffers for plain sends need a recent kernel,
+// a zero-length send tells whether the running one has them
+static bool tx_probe_fixed_send(uring_tx_t * tx)
+{
+  struct io_uring_cqe cqe;
+
+  tx->fixed_send = true;
+  tx_prep_send(tx, tx->buffer, 0, false);
+  uring_submit(&tx->ring);
+  uring_wait_cqe(&tx->ring, &cqe);
+
+  return cqe.res == 0;
+}
+
+static void tx_reap(uring_tx_t * tx, size_t unit_size, bool wait)
+{
+  struct io_uring_cqe cqe;
+
+  while (tx->in_flight > 0)
+  {
+    if (wait)
+    {
+      uring_wait_cqe(&tx->ring, &cqe);
+      wait = false;
+    }
+    else if (!uring_peek_cqe(&tx->ring, &cqe))
+    {
+      break;
+    }
+
+    assert(cqe.res > 0 && cqe.res % unit_size == 0);
+    tx->completed += cqe.res / unit_size;
+    tx->in_flight--;
+  }
+}
+
+// Sends the staged units unless a send is in flight already
+static void tx_flush(uring_tx_t * tx, size_t unit_size)
+{
+  if (tx->in_flight > 0 || tx->submitted == tx->staged)
+    return;
+
+  size_t first = tx->submitted % tx->depth;
+  size_t count = tx->staged - tx->submitted;
+  size_t head = first + count > tx->depth ? tx->depth - first : count;
+  bool wraps = head < count;
+
+  tx_prep_send(tx, tx->buffer + first * unit_size, head * unit_size, wraps);
+  if (wraps)
+    tx_prep_send(tx, tx->buffer, (count - head) * unit_size, false);
+
+  uring_submit(&tx->ring);
+  tx->in_flight = wraps ? 2 : 1;
+  tx->submitted = tx->staged;
+}
+
+static void tx_destroy(uring_tx_t * tx)
+{
+  if (tx)
+  {
+    uring_close(&tx->ring);
+    if (tx->buffer) munmap(tx->buffer, tx->buffer_size);
+    free(tx);
+  }
+}
+
+static uring_tx_t * tx_create(ipc_channel_uring_t * ipc)
+{
+  uring_tx_t * tx = calloc(1, sizeof(uring_tx_t));
+
+  if (tx == NULL)
+    return NULL;
+
+  tx->depth = ipc->depth;
+  tx->buffer_size = ipc->depth * ipc->unit_size;
+  tx->ring.fd = -1;
+
+  if ((tx->buffer = alloc_buffer(tx->buffer_size)) == NULL)
+    goto failure;
+
+  if (uring_setup(&tx->ring, tx->depth, ipc->sqpoll, NULL, ipc->conn_sockfd))
+    goto failure;
+
+  if (uring_register_buffer(&tx->ring, tx->buffer, tx->buffer_size))
+    goto failure;
+
+  tx->fixed_send = tx_probe_fixed_send(tx);
+  return tx;
+
+failure:
+  tx_destroy(tx);
+  return NULL;
+}
+
+//**************************//
+//    receive side          //
+//**************************//
+
+static void rx_arm(uring_rx_t * rx, unsigned chunk)
+{
+  struct io_uring_sqe * sqe = uring_get_sqe(&rx->ring);
+
+  sqe->opcode = IORING_OP_READ_FIXED;
+  sqe->fd = FIXED_SOCKET;
+  sqe->flags = IOSQE_FIXED_FILE;
+  sqe->addr = (unsigned long) (rx->buffer + chunk * rx->chunk_size);
+  sqe->len = rx->chunk_size;
+  sqe->buf_index = 0;
+  sqe->user_data = chunk;
+
+  uring_submit(&rx->ring);
+  rx->armed = chunk;
+}
+
+static bool rx_reap(uring_rx_t * rx, bool wait)
+{
+  struct io_uring_cqe cqe;
+
+  if (rx->armed == RX_NOT_ARMED)
+    return false;
+
+  if (wait)
+    uring_wait_cqe(&rx->ring, &cqe);
+  else if (!uring_peek_cqe(&rx->ring, &cqe))
+    return false;
+
+  if (cqe.res <= 0)
+  {
+    // the peer is gone, pop asserts once it runs out of data
+    rx->armed = RX_NOT_ARMED;
+    return false;
+  }
+
+  rx->lengths[cqe.user_data] = cqe.res;
+
+  // go on with the next chunk unless all of them are filled
+  unsigned next = (cqe.user_data + 1) % rx->depth;
+  if (next != rx->current)
+    rx_arm(rx, next);
+  else
+    rx->armed = RX_NOT_ARMED;
+
+  return true;
+}
+
+static void rx_destroy(uring_rx_t * rx)
+{
+  if (rx)
+  {
+    uring_close(&rx->ring);
+    if (rx->buffer) munmap(rx->buffer, rx->buffer_size);
+    free(rx->lengths);
+    free(rx);
+  }
+}
+
+static uring_rx_t * rx_create(ipc_channel_uring_t * ipc)
+{
+  uring_rx_t * rx = calloc(1, sizeof(uring_rx_t));
+
+  if (rx == NULL)
+    return NULL;
+
+  rx->depth = ipc->depth;
+  rx->chunk_size = ipc->unit_size > RX_CHUNK_SIZE ? ipc->unit_size : RX_CHUNK_SIZE;
+  rx->buffer_size = rx->depth * rx->chunk_size;
+  rx->ring.fd = -1;
+
+  if ((rx->lengths = calloc(rx->depth, sizeof(int))) == NULL)
+    goto failure;
+
+  if ((rx->buffer = alloc_buffer(rx->buffer_size)) == NULL)
+    goto failure;
+
+  // one polling thread serves both directions of a side
+  if (uring_setup(&rx->ring, rx->depth, ipc->sqpoll, &ipc->tx->ring, ipc->conn_sockfd))
+    goto failure;
+
+  if (uring_register_buffer(&rx->ring, rx->buffer, rx->buffer_size))
+    goto failure;
+
+  rx_arm(rx, 0);
+  return rx;
+
+failure:
+  rx_destroy(rx);
+  return NULL;
+}
+
+//**************************//
+//    channel api           //
+//**************************//
+
+static int push(void * self, const void * buffer)
+{
+  ipc_channel_uring_t * ipc = self;
+  uring_tx_t * tx = ipc->tx;
+
+  // wait for a slot only when all of them are taken
+  tx_reap(tx, ipc->unit_size, false);
+  tx_flush(tx, ipc->unit_size);
+
+  while (tx->staged - tx->completed == tx->depth)
+  {
+    tx_reap(tx, ipc->unit_size, true);
+    tx_flush(tx, ipc->unit_size);
+  }
+
+  char * slot = tx->buffer + (tx->staged % tx->depth) * ipc->unit_size;
+  memcpy(slot, buffer, ipc->unit_size);
+  tx->staged++;
+
+  tx_flush(tx, ipc->unit_size);
+  return 0;
+}
+
+static void pop(void * self, void * buffer)
+{
+  ipc_channel_uring_t * ipc = self;
+  uring_rx_t * rx = ipc->rx;
+
+  char * out = buffer;
+  size_t need = ipc->unit_size;
+
+  // keep the kernel filling chunks while the filled ones are drained
+  rx_reap(rx, false);
+
+  while (need > 0)
+  {
+    int length = rx->lengths[rx->current];
+
+    if (length <= 0)
+    {
+      bool ret = rx_reap(rx, true);
+      assert(ret);
+      continue;
+    }
+
+    size_t n = length - rx->offset < need ? length - rx->offset : need;
+    memcpy(out, rx->buffer + rx->current * rx->chunk_size + rx->offset, n);
+    out += n;
+    need -= n;
+    rx->offset += n;
+
+    if (rx->offset == length)
+    {
+      unsigned drained = rx->current;
+
+      rx->lengths[drained] = 0;
+      rx->current = (drained + 1) % rx->depth;
+      rx->offset = 0;
+
+      if (rx->armed == RX_NOT_ARMED)
+        rx_arm(rx, drained);
+    }
+  }
+}
+
+static void destroy(void * self)
+{
+  if (self)
+  {
+    ipc_channel_uring_t * ipc = self;
+
+    // let the staged units reach the peer
+    while (ipc->tx->completed < ipc->tx->staged)
+    {
+      tx_flush(ipc->tx, ipc->unit_size);
+      tx_reap(ipc->tx, ipc->unit_size, true);
+    }
+
+    tx_destroy(ipc->tx);
+    rx_destroy(ipc->rx);
+    close(ipc->sockfd);
+    close(ipc->conn_sockfd);
+    free(ipc);
+  }
+}
+
+ipc_channel_api_t * ipc_channel_uring_create(const char                  * sock_path,
+                                             size_t                        unit_size,
+                                             const ipc_channel_options_t * opts)
+{
+  ipc_channel_uring_t * ipc = NULL;
+  int sockpair[2] = { -1, -1 };
+
+  if ((ipc = calloc(1, sizeof(ipc_channel_uring_t))) == NULL)
+    goto failure;
+
+  if (ipc_domain_sockpair_connect(sock_path, &sockpair) != 0)
+    goto failure;
+
+  ipc->sockfd = sockpair[0];
+  ipc->conn_sockfd = sockpair[1];
+  ipc->sock_path = sock_path; // ISSUE: static lifetime assumption
+  ipc->unit_size = unit_size;
+  ipc->depth = opts->uring.depth ? opts->uring.depth : DEFAULT_DEPTH;
+  ipc->sqpoll = opts->uring.sqpoll;
+
+  // both rings are set up here, a side may push and pop, and io_uring
+  // turned off by a sysctl or seccomp fails the channel, not its first use
+  if ((ipc->tx = tx_create(ipc)) == NULL || (ipc->rx = rx_create(ipc)) == NULL)
+    goto failure;
+
+  ipc->api.push = push;
+  ipc->api.pop = pop;
+  ipc->api.destroy = destroy;
+  ipc->api.try_pop = NULL;
+  ipc->api.bind = NULL;
+  ipc->api.gauges = NULL;
+
+  return (ipc_channel_api_t *) ipc;
+
+failure:
+  if (ipc)
+  {
+    tx_destroy(ipc->tx);
+    rx_destroy(ipc->rx);
+  }
+  close(sockpair[0]);
+  close(sockpair[1]);
+  free(ipc);
+  return NULL;
+}
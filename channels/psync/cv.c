@@ -1,43 +1,53 @@
+#include "futex.h"
+
 #include "cv.h"
 
 int ipc_cv_init(ipc_cv_t * cv)
 {
   assert(cv);
-  
-  int ret = 0;
-  pthread_condattr_t condattr;
-
-  if ((ret = pthread_condattr_init(&condattr)))
-    return ret;
-
-  if ((ret = pthread_condattr_setpshared(&condattr, PTHREAD_PROCESS_SHARED)))
-    goto exit;
-
-  if ((ret = pthread_cond_init(&cv->plain, &condattr)))
-    goto exit;
 
-exit:
-  IPC_EOK(pthread_condattr_destroy(&condattr));
-  return ret;
+  atomic_init(&cv->seq, 0);
+  return 0;
 }
 
 void ipc_cv_destroy(ipc_cv_t * cv)
 {
   assert(cv);
-  IPC_EOK(pthread_cond_destroy(&cv->plain));
 }
 
-void ipc_cv_wait(ipc_cv_t * cv, ipc_mutex_t * mutex)
+int ipc_cv_wait(ipc_cv_t * cv, ipc_mutex_t * mutex)
+{
+  return ipc_cv_timedwait(cv, mutex, NULL);
+}
+
+int ipc_cv_timedwait(ipc_cv_t * cv, ipc_mutex_t * mutex, const struct timespec * timeout)
 {
   assert(cv);
   assert(mutex);
-  
-  IPC_EOK(pthread_cond_wait(&cv->plain, &mutex->plain));
+
+  // the sequence is read under the mutex, a notification after
+  // the unlock changes it and the futex doesn't go to sleep
+  unsigned seen = atomic_load_explicit(&cv->seq, memory_order_relaxed);
+
+  ipc_mutex_unlock(mutex);
+  int waited = ipc_futex_wait(&cv->seq, seen, timeout);
+
+  int ret = ipc_mutex_lock(mutex);
+  return ret ? ret : waited;
 }
 
 void ipc_cv_notify_one(ipc_cv_t * cv)
 {
   assert(cv);
-  
-  IPC_EOK(pthread_cond_signal(&cv->plain));
+
+  atomic_fetch_add_explicit(&cv->seq, 1, memory_order_release);
+  ipc_futex_wake(&cv->seq, 1);
+}
+
+void ipc_cv_notify_all(ipc_cv_t * cv)
+{
+  assert(cv);
+
+  atomic_fetch_add_explicit(&cv->seq, 1, memory_order_release);
+  ipc_futex_wake_all(&cv->seq);
 }
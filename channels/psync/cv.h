@@ -1,19 +1,31 @@
 #ifndef IPC_PSYNC_CV_H
 #define IPC_PSYNC_CV_H
 
-#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
 
 #include "mutex.h"
 
+// A sequence word bumped by every notification, waiters sleep on it
+// with a futex. No waiter leaves any state behind, so a peer killed
+// inside `ipc_cv_wait` can't swallow notifications of the live ones
+// or hang `ipc_cv_destroy` the way a process-shared pthread_cond_t does.
 typedef struct
 {
-  pthread_cond_t plain;
+  atomic_uint seq;
 } ipc_cv_t;
 
 int ipc_cv_init(ipc_cv_t * cv);
 void ipc_cv_destroy(ipc_cv_t * cv);
 
-void ipc_cv_wait(ipc_cv_t * cv, ipc_mutex_t * mutex);
+// Returns EOWNERDEAD the same way as `ipc_mutex_lock`,
+// wake ups may be spurious
+int ipc_cv_wait(ipc_cv_t * cv, ipc_mutex_t * mutex);
+
+// Waits at most the relative `timeout`, returns ETIMEDOUT when
+// it runs out unless the mutex comes back with EOWNERDEAD
+int ipc_cv_timedwait(ipc_cv_t * cv, ipc_mutex_t * mutex, const struct timespec * timeout);
 void ipc_cv_notify_one(ipc_cv_t * cv);
+void ipc_cv_notify_all(ipc_cv_t * cv);
 
 #endif
@@ -0,0 +1,51 @@
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "futex.h"
+
+static long futex(atomic_uint * word, int op, unsigned val, const struct timespec * timeout)
+{
+  return syscall(SYS_futex, word, op, val, timeout, NULL, 0);
+}
+
+static int futex_wait(atomic_uint * word, int op, unsigned expected, const struct timespec * timeout)
+{
+  assert(word);
+
+  if (futex(word, op, expected, timeout) == 0)
+    return 0;
+
+  // EAGAIN: the word has changed already, EINTR: a spurious wake up,
+  // both are the same as a wake up for the caller re-checking its condition
+  return errno == ETIMEDOUT ? ETIMEDOUT : 0;
+}
+
+int ipc_futex_wait(atomic_uint * word, unsigned expected, const struct timespec * timeout)
+{
+  return futex_wait(word, FUTEX_WAIT, expected, timeout);
+}
+
+void ipc_futex_wake(atomic_uint * word, int waiters)
+{
+  assert(word);
+  futex(word, FUTEX_WAKE, waiters, NULL);
+}
+
+int ipc_futex_wait_private(atomic_uint * word, unsigned expected, const struct timespec * timeout)
+{
+  return futex_wait(word, FUTEX_WAIT_PRIVATE, expected, timeout);
+}
+
+void ipc_futex_wake_private(atomic_uint * word, int waiters)
+{
+  assert(word);
+  futex(word, FUTEX_WAKE_PRIVATE, waiters, NULL);
+}
+
+void ipc_futex_wake_all(atomic_uint * word)
+{
+  ipc_futex_wake(word, INT_MAX);
+}
@@ -0,0 +1,24 @@
+#ifndef IPC_PSYNC_FUTEX_H
+#define IPC_PSYNC_FUTEX_H
+
+#include <stdatomic.h>
+#include <time.h>
+
+#include "channels/macros.h"
+
+// Process-shared futex on a 32-bit word, usable in any MAP_SHARED memory
+
+// Sleeps while `*word == expected`, returns 0 on wake up,
+// ETIMEDOUT when `timeout` (relative, may be NULL) expires
+int ipc_futex_wait(atomic_uint * word, unsigned expected, const struct timespec * timeout);
+
+void ipc_futex_wake(atomic_uint * word, int waiters);
+void ipc_futex_wake_all(atomic_uint * word);
+
+// The same for a word used by the threads of one process only
+// (FUTEX_PRIVATE_FLAG), the kernel keys it by the address alone
+int ipc_futex_wait_private(atomic_uint * word, unsigned expected, const struct timespec * timeout);
+
+void ipc_futex_wake_private(atomic_uint * word, int waiters);
+
+#endif
@@ -1,3 +1,5 @@
+#include <errno.h>
+
 #include "mutex.h"
 
 int ipc_mutex_init(ipc_mutex_t * mutex)
@@ -13,6 +15,11 @@ int ipc_mutex_init(ipc_mutex_t * mutex)
   if ((ret = pthread_mutexattr_setpshared(&mutexattr, PTHREAD_PROCESS_SHARED)))
     goto exit;
 
+  // a peer may die inside of its critical section,
+  // the survivor must not hang on the lock forever
+  if ((ret = pthread_mutexattr_setrobust(&mutexattr, PTHREAD_MUTEX_ROBUST)))
+    goto exit;
+
   if ((ret = pthread_mutex_init(&mutex->plain, &mutexattr)))
     goto exit;
 
@@ -27,10 +34,26 @@ void ipc_mutex_destroy(ipc_mutex_t * mutex)
   IPC_EOK(pthread_mutex_destroy(&mutex->plain));
 }
 
-void ipc_mutex_lock(ipc_mutex_t * mutex)
+int ipc_mutex_recover(ipc_mutex_t * mutex, int status)
+{
+  assert(mutex);
+
+  if (status == EOWNERDEAD)
+  {
+    // the lock is held now, the protected state is left
+    // for the caller to repair
+    IPC_EOK(pthread_mutex_consistent(&mutex->plain));
+    return EOWNERDEAD;
+  }
+
+  IPC_EOK(status);
+  return 0;
+}
+
+int ipc_mutex_lock(ipc_mutex_t * mutex)
 {
   assert(mutex);
-  IPC_EOK(pthread_mutex_lock(&mutex->plain));
+  return ipc_mutex_recover(mutex, pthread_mutex_lock(&mutex->plain));
 }
 
 void ipc_mutex_unlock(ipc_mutex_t * mutex)
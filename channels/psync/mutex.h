@@ -13,9 +13,14 @@ typedef struct
 int ipc_mutex_init(ipc_mutex_t * mutex);
 void ipc_mutex_destroy(ipc_mutex_t * mutex);
 
-void ipc_mutex_lock(ipc_mutex_t * mutex);
+// Returns EOWNERDEAD if the previous owner died holding the mutex,
+// the mutex is acquired and consistent again in that case
+int ipc_mutex_lock(ipc_mutex_t * mutex);
 void ipc_mutex_unlock(ipc_mutex_t * mutex);
 
+// Marks the mutex consistent after `status` == EOWNERDEAD, aborts on other errors
+int ipc_mutex_recover(ipc_mutex_t * mutex, int status);
+
 #define IPC_CRITICAL_SECTION(p_mutex)        \
   IPC_DEFER(ipc_mutex_lock(p_mutex),         \
             ipc_mutex_unlock(p_mutex))
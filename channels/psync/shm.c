@@ -0,0 +1,324 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "futex.h"
+#include "shm.h"
+
+// where shm_open keeps the segments, create_sized links them there
+#define SHM_DIR         "/dev/shm"
+
+// how often a BUSY waiter checks that the owner is still alive
+#define OWNER_CHECK_NS  (10 * 1000 * 1000)
+
+static bool is_alive(pid_t pid)
+{
+  return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+static void state_set(ipc_shm_header_t * header, ipc_shm_state_t state)
+{
+  atomic_store_explicit(&header->state, state, memory_order_release);
+  ipc_futex_wake_all(&header->state);
+}
+
+// Moves the segment to BUSY, returns the state it was in before
+static ipc_shm_state_t state_acquire(ipc_shm_header_t * header)
+{
+  const struct timespec check = { .tv_nsec = OWNER_CHECK_NS };
+  int self = getpid();
+
+  while (true)
+  {
+    unsigned state = atomic_load_explicit(&header->state, memory_order_acquire);
+
+    if (state == IPC_SHM_DEAD)
+      return IPC_SHM_DEAD;
+
+    if (state != IPC_SHM_BUSY)
+    {
+      if (atomic_compare_exchange_weak(&header->state, &state, IPC_SHM_BUSY))
+      {
+        atomic_store_explicit(&header->owner, self, memory_order_relaxed);
+        return state;
+      }
+
+      continue;
+    }
+
+    if (ipc_futex_wait(&header->state, IPC_SHM_BUSY, &check) != ETIMEDOUT)
+      continue;
+
+    int owner = atomic_load_explicit(&header->owner, memory_order_relaxed);
+    if (owner != 0 && !is_alive(owner) &&
+        atomic_compare_exchange_strong(&header->owner, &owner, self))
+    {
+      // the owner died in the middle, whatever it did
+      // has to be done again from scratch
+      return IPC_SHM_EMPTY;
+    }
+  }
+}
+
+static int claim_slot(ipc_shm_header_t * header)
+{
+  int self = getpid();
+
+  for (int i = 0; i < IPC_SHM_MAX_ATTACHERS; i++)
+  {
+    int vacant = 0;
+    if (atomic_compare_exchange_strong(&header->attachers[i], &vacant, self))
+      return 0;
+  }
+
+  return EBUSY;
+}
+
+static void release_slot(ipc_shm_header_t * header)
+{
+  int self = getpid();
+
+  for (int i = 0; i < IPC_SHM_MAX_ATTACHERS; i++)
+  {
+    int holder = self;
+    if (atomic_compare_exchange_strong(&header->attachers[i], &holder, 0))
+      return;
+  }
+}
+
+// A holder is one taken slot, so taking and dropping it is a single step
+// and a holder which dies at any point is counted the same way by everyone
+static unsigned holders(ipc_shm_header_t * header)
+{
+  unsigned count = 0;
+
+  for (int i = 0; i < IPC_SHM_MAX_ATTACHERS; i++)
+  {
+    if (atomic_load_explicit(&header->attachers[i], memory_order_acquire) != 0)
+      count++;
+  }
+
+  return count;
+}
+
+unsigned ipc_shm_reap(ipc_shm_header_t * header)
+{
+  assert(header);
+
+  unsigned reaped = 0;
+
+  for (int i = 0; i < IPC_SHM_MAX_ATTACHERS; i++)
+  {
+    int holder = atomic_load_explicit(&header->attachers[i], memory_order_acquire);
+
+    if (holder == 0 || is_alive(holder))
+      continue;
+
+    if (atomic_compare_exchange_strong(&header->attachers[i], &holder, 0))
+      reaped++;
+  }
+
+  return reaped;
+}
+
+// Creates a segment of `size` bytes under a temporary name and publishes
+// it as `name` with link(2), which never replaces an existing one,
+// so an attacher can't see a segment which isn't sized yet.
+// Returns the descriptor, -1 with EEXIST if somebody else published first
+static int create_sized(const char * name, size_t size)
+{
+  char tmp_name[NAME_MAX], tmp_path[PATH_MAX], path[PATH_MAX];
+  int shm = -1;
+
+  // shm_open(3) takes names with or without the leading slash
+  const char * slash = name[0] == '/' ? "" : "/";
+
+  snprintf(tmp_name, sizeof(tmp_name), "%s.%d.tmp", name, getpid());
+  snprintf(tmp_path, sizeof(tmp_path), "%s%s%s", SHM_DIR, slash, tmp_name);
+  snprintf(path, sizeof(path), "%s%s%s", SHM_DIR, slash, name);
+
+  // a leftover of a dead process which had the same pid
+  shm_unlink(tmp_name);
+
+  if ((shm = shm_open(tmp_name, O_CREAT|O_EXCL|O_RDWR, 0600)) < 0)
+    return -1;
+
+  if (ftruncate(shm, size) || link(tmp_path, path))
+  {
+    int err = errno;
+
+    close(shm);
+    shm_unlink(tmp_name);
+    errno = err;
+    return -1;
+  }
+
+  shm_unlink(tmp_name);
+  return shm;
+}
+
+// Opens the existing segment or creates a new one of `size` bytes,
+// returns the size of the segment which is not smaller than its header
+static int open_sized(const char * name, size_t size, size_t * real_size)
+{
+  struct stat st;
+  int shm;
+
+  while (true)
+  {
+    if ((shm = shm_open(name, O_RDWR, 0600)) >= 0)
+      break;
+
+    if (errno != ENOENT)
+      return -1;
+
+    if ((shm = create_sized(name, size)) >= 0)
+    {
+      *real_size = size;
+      return shm;
+    }
+
+    if (errno != EEXIST)
+      return -1;
+  }
+
+  // segments are published sized, a smaller one is not ours
+  int err = fstat(shm, &st) ? errno : st.st_size < sizeof(ipc_shm_header_t) ? EPROTO : 0;
+  if (err)
+  {
+    close(shm);
+    errno = err;
+    return -1;
+  }
+
+  *real_size = st.st_size;
+  return shm;
+}
+
+static int map_segment(const char * name, size_t size, void ** shared, size_t * real_size)
+{
+  int shm = open_sized(name, size, real_size);
+
+  if (shm < 0)
+    return errno;
+
+  *shared = mmap(NULL, *real_size, PROT_WRITE|PROT_READ, MAP_SHARED, shm, 0);
+  close(shm);
+
+  return *shared == MAP_FAILED ? errno : 0;
+}
+
+int ipc_shm_attach(const char    * name,
+                   size_t          size,
+                   uint64_t        layout,
+                   ipc_shm_init    init,
+                   void          * arg,
+                   void         ** shared)
+{
+  assert(name);
+  assert(init);
+  assert(shared);
+
+  ipc_shm_header_t * header = NULL;
+  size_t real_size = 0;
+  int ret = 0;
+
+  while (true)
+  {
+    if ((ret = map_segment(name, size, (void **) &header, &real_size)))
+      return ret;
+
+    if (state_acquire(header) != IPC_SHM_DEAD)
+      break;
+
+    // the last holder has just left, its successor is a new segment
+    munmap(header, real_size);
+  }
+
+  // holders which crashed would keep the segment
+  // "initialized" forever, forget them first
+  ipc_shm_reap(header);
+
+  if (holders(header) == 0)
+  {
+    // either a fresh segment or one whose holders all died
+    if (real_size != size)
+    {
+      // a leftover of a different layout, nobody holds it anymore
+      shm_unlink(name);
+      state_set(header, IPC_SHM_DEAD);
+      munmap(header, real_size);
+      return ipc_shm_attach(name, size, layout, init, arg, shared);
+    }
+
+    header->magic = 0;
+
+    if ((ret = init(header, arg)))
+      goto failure;
+
+    header->version = IPC_SHM_VERSION;
+    header->size = size;
+    header->layout = layout;
+    header->magic = IPC_SHM_MAGIC;
+  }
+  else if (header->magic   != IPC_SHM_MAGIC   ||
+           header->version != IPC_SHM_VERSION ||
+           header->size    != size            ||
+           header->layout  != layout)
+  {
+    ret = EPROTO;
+    goto failure;
+  }
+
+  if ((ret = claim_slot(header)))
+    goto failure;
+
+  state_set(header, IPC_SHM_READY);
+
+  *shared = header;
+  return 0;
+
+failure:
+  if (holders(header) > 0)
+    state_set(header, IPC_SHM_READY);
+  else
+    state_set(header, IPC_SHM_EMPTY);
+
+  munmap(header, real_size);
+  return ret;
+}
+
+void ipc_shm_detach(const char * name, void * shared, ipc_shm_fini fini, void * arg)
+{
+  assert(shared);
+
+  ipc_shm_header_t * header = shared;
+  size_t size = header->size;
+
+  state_acquire(header);
+  release_slot(header);
+
+  // the survivor of crashed holders is the last one and cleans up
+  ipc_shm_reap(header);
+
+  if (holders(header) == 0)
+  {
+    // the last holder of the shared memory
+    // must release collected there resources
+    if (fini) fini(shared, arg);
+
+    shm_unlink(name);
+    state_set(header, IPC_SHM_DEAD);
+  }
+  else
+  {
+    state_set(header, IPC_SHM_READY);
+  }
+
+  munmap(shared, size);
+}
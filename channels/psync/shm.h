@@ -0,0 +1,63 @@
+#ifndef IPC_PSYNC_SHM_H
+#define IPC_PSYNC_SHM_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "channels/macros.h"
+
+#define IPC_SHM_MAGIC         0x4950434du // "IPCM"
+#define IPC_SHM_VERSION       3
+#define IPC_SHM_MAX_ATTACHERS 32
+
+typedef enum
+{
+  IPC_SHM_EMPTY,     // fresh zeroed segment, nobody has initialized it
+  IPC_SHM_BUSY,      // `owner` initializes it or (de)registers a holder
+  IPC_SHM_READY,     // initialized, holders come and go
+  IPC_SHM_DEAD,      // released by the last holder and unlinked
+} ipc_shm_state_t;
+
+typedef struct
+{
+  // `state` is the futex word of the lifecycle state machine,
+  // `owner` is the pid of the process which moved it to BUSY
+  atomic_uint  state;
+  atomic_int   owner;
+
+  uint32_t     magic;
+  uint32_t     version;
+  uint64_t     size;
+  uint64_t     layout;
+
+  // pids of the holders, the taken slots are the holder count,
+  // a slot of a dead holder is reaped by the next attacher
+  atomic_int   attachers[IPC_SHM_MAX_ATTACHERS];
+} ipc_shm_header_t;
+
+// `shared` starts with `ipc_shm_header_t`
+typedef int (* ipc_shm_init)(void * shared, void * arg);
+typedef void (* ipc_shm_fini)(void * shared, void * arg);
+
+// Maps the segment `name` of `size` bytes with a single mmap call.
+// The first holder creates and sizes it and runs `init(shared, arg)`,
+// the concurrent attachers sleep on a futex until it is done.
+// `layout` is an arbitrary tag (e.g. unit size) which has to match
+// between the holders, EPROTO is returned otherwise.
+int ipc_shm_attach(const char    * name,
+                   size_t          size,
+                   uint64_t        layout,
+                   ipc_shm_init    init,
+                   void          * arg,
+                   void         ** shared);
+
+// Unmaps the segment, the last holder runs `fini(shared, arg)`
+// and unlinks `name`
+void ipc_shm_detach(const char * name, void * shared, ipc_shm_fini fini, void * arg);
+
+// Drops the holders which died without detaching, returns their number
+unsigned ipc_shm_reap(ipc_shm_header_t * header);
+
+#endif
@@ -0,0 +1,195 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "channels/psync/futex.h"
+#include "channels/psync/shm.h"
+
+#include "waitset.h"
+
+#define READY_WORDS     (IPC_WAITSET_MAX_CHANNELS / 64)
+#define WAITSET_LAYOUT  IPC_WAITSET_MAX_CHANNELS
+
+typedef struct
+{
+  ipc_shm_header_t header;
+
+  // bumped when a clear slot is raised, the consumer sleeps on it
+  atomic_uint      seq;
+  atomic_uint      waiting;
+  atomic_ullong    ready[READY_WORDS];
+} waitset_shared_t;
+
+struct ipc_waitset
+{
+  char                  name[IPC_WAITSET_NAME_MAX];
+  waitset_shared_t    * shared;
+  ipc_waitset_order_t   order;
+  unsigned              next;
+  ipc_channel_api_t   * members[IPC_WAITSET_MAX_CHANNELS];
+};
+
+static int waitset_shared_create(void * shared_mem, void * arg)
+{
+  waitset_shared_t * shared = shared_mem;
+
+  atomic_init(&shared->seq, 0);
+  atomic_init(&shared->waiting, 0);
+
+  for (int i = 0; i < READY_WORDS; i++)
+    atomic_init(&shared->ready[i], 0);
+
+  return 0;
+}
+
+ipc_waitset_t * ipc_waitset_create(const char * name, ipc_waitset_order_t order)
+{
+  ipc_waitset_t * waitset = NULL;
+  void * shared_mem = NULL;
+
+  if (strlen(name) >= IPC_WAITSET_NAME_MAX)
+    goto failure;
+
+  if ((waitset = calloc(1, sizeof(ipc_waitset_t))) == NULL)
+    goto failure;
+
+  strcpy(waitset->name, name);
+
+  if (ipc_shm_attach(waitset->name,
+                     sizeof(waitset_shared_t),
+                     WAITSET_LAYOUT,
+                     waitset_shared_create,
+                     waitset,
+                     &shared_mem))
+    goto failure;
+
+  waitset->shared = shared_mem;
+  waitset->order = order;
+  waitset->next = 0;
+
+  return waitset;
+
+failure:
+  free(waitset);
+  return NULL;
+}
+
+void ipc_waitset_destroy(ipc_waitset_t * waitset)
+{
+  if (waitset)
+  {
+    // the members are not touched, they are usually destroyed by now;
+    // producers of one still bound keep their own hold of the segment
+    ipc_shm_detach(waitset->name, waitset->shared, NULL, NULL);
+    free(waitset);
+  }
+}
+
+int ipc_waitset_add(ipc_waitset_t * waitset, unsigned slot, ipc_channel_api_t * channel)
+{
+  int ret = 0;
+
+  if (slot >= IPC_WAITSET_MAX_CHANNELS || waitset->members[slot] != NULL)
+    return EINVAL;
+
+  if (channel->try_pop == NULL || channel->bind == NULL)
+    return ENOTSUP;
+
+  if ((ret = channel->bind(channel, waitset->name, slot)))
+    return ret;
+
+  waitset->members[slot] = channel;
+
+  // the units pushed before the binding raised nothing
+  ipc_waitset_raise(waitset, slot);
+  return 0;
+}
+
+void ipc_waitset_remove(ipc_waitset_t * waitset, unsigned slot)
+{
+  assert(slot < IPC_WAITSET_MAX_CHANNELS);
+
+  ipc_channel_api_t * channel = waitset->members[slot];
+  if (channel)
+  {
+    channel->bind(channel, NULL, 0);
+    waitset->members[slot] = NULL;
+    atomic_fetch_and(&waitset->shared->ready[slot / 64], ~(1ull << slot % 64));
+  }
+}
+
+void ipc_waitset_raise(ipc_waitset_t * waitset, unsigned slot)
+{
+  waitset_shared_t * shared = waitset->shared;
+  uint64_t bit = 1ull << slot % 64;
+
+  // a raised slot is going to be looked at anyway
+  if (atomic_fetch_or(&shared->ready[slot / 64], bit) & bit)
+    return;
+
+  atomic_fetch_add(&shared->seq, 1);
+  if (atomic_load(&shared->waiting) > 0)
+    ipc_futex_wake(&shared->seq, 1);
+}
+
+// Returns the raised slot to serve next, or -1 when none is raised
+static int next_ready(ipc_waitset_t * waitset)
+{
+  waitset_shared_t * shared = waitset->shared;
+  unsigned from = waitset->order == IPC_WAITSET_FAIR ? waitset->next : 0;
+
+  for (unsigned i = 0; i < IPC_WAITSET_MAX_CHANNELS; )
+  {
+    unsigned slot = (from + i) % IPC_WAITSET_MAX_CHANNELS;
+    uint64_t word = atomic_load(&shared->ready[slot / 64]) >> slot % 64;
+
+    if (word == 0)
+    {
+      // skip the rest of the word
+      i += 64 - slot % 64;
+      continue;
+    }
+
+    return (slot + __builtin_ctzll(word)) % IPC_WAITSET_MAX_CHANNELS;
+  }
+
+  return -1;
+}
+
+unsigned ipc_waitset_pop(ipc_waitset_t * waitset, void * buffer)
+{
+  waitset_shared_t * shared = waitset->shared;
+
+  for (;;)
+  {
+    unsigned seq = atomic_load(&shared->seq);
+    int slot;
+
+    while ((slot = next_ready(waitset)) != -1)
+    {
+      uint64_t bit = 1ull << slot % 64;
+      ipc_channel_api_t * channel = waitset->members[slot];
+
+      // the slot is cleared before looking into the channel,
+      // a push after that raises it again
+      atomic_fetch_and(&shared->ready[slot / 64], ~bit);
+
+      if (channel && channel->try_pop(channel, buffer))
+      {
+        // the channel may hold more units
+        atomic_fetch_or(&shared->ready[slot / 64], bit);
+        waitset->next = slot + 1;
+        return slot;
+      }
+    }
+
+    // a raise after `seq` was read changes it, so the wait returns at once
+    atomic_fetch_add(&shared->waiting, 1);
+    ipc_futex_wait(&shared->seq, seq, NULL);
+    atomic_fetch_sub(&shared->waiting, 1);
+  }
+}
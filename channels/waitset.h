@@ -0,0 +1,43 @@
+#ifndef IPC_WAITSET_API_H
+#define IPC_WAITSET_API_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "channel.h"
+
+// A consumer blocks on many channels at once: the wait-set is a shared
+// memory segment `name` holding a ready bitmap and a futex word.
+// Producers of a bound channel raise its slot on push, and wake
+// the consumer only when the slot was clear.
+
+#define IPC_WAITSET_MAX_CHANNELS 256
+#define IPC_WAITSET_NAME_MAX     64
+
+typedef enum
+{
+  IPC_WAITSET_FAIR,       // round-robin over the ready channels
+  IPC_WAITSET_PRIORITY,   // the ready channel with the lowest slot first
+} ipc_waitset_order_t;
+
+typedef struct ipc_waitset ipc_waitset_t;
+
+ipc_waitset_t * ipc_waitset_create(const char * name, ipc_waitset_order_t order);
+
+// Forgets the members without touching them, so the channels may be
+// destroyed before it; a member which outlives the wait-set stays bound
+// until it is removed beforehand or `channel->bind(channel, NULL, 0)`
+void ipc_waitset_destroy(ipc_waitset_t * waitset);
+
+// Binds `channel` (it needs `try_pop` and `bind`) to `slot`,
+// which is its priority too, returns 0 or an errno value
+int ipc_waitset_add(ipc_waitset_t * waitset, unsigned slot, ipc_channel_api_t * channel);
+void ipc_waitset_remove(ipc_waitset_t * waitset, unsigned slot);
+
+// Blocks until a member has a unit and pops it, returns its slot
+unsigned ipc_waitset_pop(ipc_waitset_t * waitset, void * buffer);
+
+// Producer side, used by the channel flavors
+void ipc_waitset_raise(ipc_waitset_t * waitset, unsigned slot);
+
+#endif
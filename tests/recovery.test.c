@@ -0,0 +1,377 @@
+#include <assert.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "channels/channel.h"
+#include "channels/duplex.h"
+
+#define MMAP_NAME     "/ipc_recovery_test_mmap_48311"
+#define DUPLEX_NAME   "/ipc_recovery_test_duplex_48312"
+#define UNIT_SIZE     8
+#define ROUNDS        2000
+
+// a hang is the failure this test looks for
+#define TIMEOUT_SEC   20
+
+static void settle(void)
+{
+  // long enough for a child to fall asleep on a condition variable
+  nanosleep(&(struct timespec) { .tv_nsec = 200 * 1000 * 1000 }, NULL);
+}
+
+static void kill_child(pid_t pid)
+{
+  kill(pid, SIGKILL);
+  waitpid(pid, NULL, 0);
+}
+
+static void join_child(pid_t pid)
+{
+  int status = 0;
+
+  waitpid(pid, &status, 0);
+  assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+static void join_killed(pid_t pid, int signal)
+{
+  int status = 0;
+
+  waitpid(pid, &status, 0);
+  assert(WIFSIGNALED(status) && WTERMSIG(status) == signal);
+}
+
+// Memory past the end of an empty file, a copy from or to it raises
+// SIGBUS, so a peer dies in the middle of a critical section
+// (without a core dump, the death is expected)
+static void * faulting_buffer(void)
+{
+  setrlimit(RLIMIT_CORE, &(struct rlimit) { 0, 0 });
+
+  char path[] = "/tmp/ipc_recovery_test_XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd != -1);
+  unlink(path);
+
+  void * buffer = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  assert(buffer != MAP_FAILED);
+  close(fd);
+
+  return buffer;
+}
+
+static pid_t spawn_consumer(size_t from, size_t count)
+{
+  pid_t pid = fork();
+  if (pid)
+    return pid;
+
+  ipc_channel_api_t * ipc = ipc_channel_create(MMAP_NAME, UNIT_SIZE, IPC_CHANNEL_FLAVOR_MMAP);
+  assert(ipc != NULL);
+
+  for (size_t i = from; i < from + count; i++)
+  {
+    size_t unit;
+    ipc->pop(ipc, &unit);
+    if (unit != i)
+      exit(1);
+  }
+
+  ipc->destroy(ipc);
+  exit(0);
+}
+
+// A consumer killed asleep in pop leaves a reference in the condvar,
+// the producer and the next consumer carry on and the last one out
+// finalizes the segment
+static void consumer_killed_in_wait(void)
+{
+  ipc_channel_api_t * producer = ipc_channel_create(MMAP_NAME, UNIT_SIZE, IPC_CHANNEL_FLAVOR_MMAP);
+  assert(producer != NULL);
+
+  pid_t victim = spawn_consumer(0, 1);
+  settle();
+  kill_child(victim);
+
+  pid_t survivor = spawn_consumer(0, ROUNDS);
+
+  for (size_t i = 0; i < ROUNDS; i++)
+  {
+    producer->push(producer, &i);
+
+    // the consumer falls asleep on an empty ring over and over
+    if (i % 64 == 0)
+      usleep(100);
+  }
+
+  join_child(survivor);
+  producer->destroy(producer);
+}
+
+// A producer killed asleep on a full ring
+static void producer_killed_in_wait(void)
+{
+  ipc_channel_api_t * consumer = ipc_channel_create(MMAP_NAME, UNIT_SIZE, IPC_CHANNEL_FLAVOR_MMAP);
+  assert(consumer != NULL);
+
+  pid_t victim = fork();
+  if (!victim)
+  {
+    ipc_channel_api_t * ipc = ipc_channel_create(MMAP_NAME, UNIT_SIZE, IPC_CHANNEL_FLAVOR_MMAP);
+    assert(ipc != NULL);
+
+    for (size_t i = 0; ; i++)
+      ipc->push(ipc, &i);
+  }
+
+  settle();
+  kill_child(victim);
+
+  // whatever the victim has pushed is there in order
+  size_t unit, expected = 0;
+  while (consumer->try_pop(consumer, &unit))
+    assert(unit == expected++);
+
+  consumer->destroy(consumer);
+}
+
+// A producer killed holding the mutex, the lock comes back with
+// EOWNERDEAD and the consumer asleep on the empty ring is woken
+static void producer_killed_holding_lock(void)
+{
+  ipc_channel_api_t * producer = ipc_channel_create(MMAP_NAME, UNIT_SIZE, IPC_CHANNEL_FLAVOR_MMAP);
+  assert(producer != NULL);
+
+  pid_t survivor = spawn_consumer(0, ROUNDS);
+  settle();
+
+  pid_t victim = fork();
+  if (!victim)
+  {
+    ipc_channel_api_t * ipc = ipc_channel_create(MMAP_NAME, UNIT_SIZE, IPC_CHANNEL_FLAVOR_MMAP);
+    assert(ipc != NULL);
+
+    ipc->push(ipc, faulting_buffer());
+    exit(0);
+  }
+
+  join_killed(victim, SIGBUS);
+
+  for (size_t i = 0; i < ROUNDS; i++)
+    producer->push(producer, &i);
+
+  join_child(survivor);
+  producer->destroy(producer);
+}
+
+// A consumer killed holding the mutex before it takes the unit,
+// the unit is left for the next one
+static void consumer_killed_holding_lock(void)
+{
+  ipc_channel_api_t * producer = ipc_channel_create(MMAP_NAME, UNIT_SIZE, IPC_CHANNEL_FLAVOR_MMAP);
+  assert(producer != NULL);
+
+  size_t unit = 0;
+  producer->push(producer, &unit);
+
+  pid_t victim = fork();
+  if (!victim)
+  {
+    ipc_channel_api_t * ipc = ipc_channel_create(MMAP_NAME, UNIT_SIZE, IPC_CHANNEL_FLAVOR_MMAP);
+    assert(ipc != NULL);
+
+    ipc->pop(ipc, faulting_buffer());
+    exit(0);
+  }
+
+  join_killed(victim, SIGBUS);
+
+  pid_t survivor = spawn_consumer(0, ROUNDS);
+
+  for (size_t i = 1; i < ROUNDS; i++)
+    producer->push(producer, &i);
+
+  join_child(survivor);
+  producer->destroy(producer);
+}
+
+// A client killed holding the request ring, its half written
+// request is never published
+static void client_killed_holding_lock(void)
+{
+  ipc_duplex_t * server = ipc_duplex_create(DUPLEX_NAME, UNIT_SIZE, IPC_DUPLEX_SERVER);
+  assert(server != NULL);
+
+  pid_t victim = fork();
+  if (!victim)
+  {
+    ipc_duplex_t * client = ipc_duplex_create(DUPLEX_NAME, UNIT_SIZE, IPC_DUPLEX_CLIENT);
+    assert(client != NULL);
+
+    ipc_duplex_send(client, faulting_buffer());
+    exit(0);
+  }
+
+  join_killed(victim, SIGBUS);
+
+  pid_t survivor = fork();
+  if (!survivor)
+  {
+    ipc_duplex_t * client = ipc_duplex_create(DUPLEX_NAME, UNIT_SIZE, IPC_DUPLEX_CLIENT);
+    assert(client != NULL);
+
+    for (size_t i = 0; i < ROUNDS; i++)
+    {
+      size_t reply;
+      ipc_duplex_call(client, &i, &reply);
+      if (reply != i)
+        exit(1);
+    }
+
+    ipc_duplex_destroy(client);
+    exit(0);
+  }
+
+  for (size_t i = 0; i < ROUNDS; i++)
+  {
+    size_t request;
+    ipc_corr_id_t id = ipc_duplex_recv(server, &request);
+    ipc_duplex_reply(server, id, &request);
+  }
+
+  join_child(survivor);
+  ipc_duplex_destroy(server);
+}
+
+// A client killed waiting for its reply, the server replies to nobody
+// and the next client gets its own reply
+static void client_killed_in_wait(void)
+{
+  ipc_duplex_t * server = ipc_duplex_create(DUPLEX_NAME, UNIT_SIZE, IPC_DUPLEX_SERVER);
+  assert(server != NULL);
+
+  pid_t victim = fork();
+  if (!victim)
+  {
+    ipc_duplex_t * client = ipc_duplex_create(DUPLEX_NAME, UNIT_SIZE, IPC_DUPLEX_CLIENT);
+    size_t request = 1, reply;
+
+    ipc_duplex_call(client, &request, &reply);
+    exit(0);
+  }
+
+  size_t request;
+  ipc_corr_id_t id = ipc_duplex_recv(server, &request);
+  settle();
+  kill_child(victim);
+  ipc_duplex_reply(server, id, &request);
+
+  pid_t survivor = fork();
+  if (!survivor)
+  {
+    ipc_duplex_t * client = ipc_duplex_create(DUPLEX_NAME, UNIT_SIZE, IPC_DUPLEX_CLIENT);
+    assert(client != NULL);
+
+    for (size_t i = 0; i < ROUNDS; i++)
+    {
+      size_t reply;
+      ipc_duplex_call(client, &i, &reply);
+      if (reply != i)
+        exit(1);
+    }
+
+    ipc_duplex_destroy(client);
+    exit(0);
+  }
+
+  for (size_t i = 0; i < ROUNDS; i++)
+  {
+    id = ipc_duplex_recv(server, &request);
+    ipc_duplex_reply(server, id, &request);
+  }
+
+  join_child(survivor);
+  ipc_duplex_destroy(server);
+}
+
+// Replies to callers which are gone fill the reply ring, a full ring
+// drops them instead of blocking the server for good
+static void replies_to_dead_callers(void)
+{
+  enum { CALLS = 2 * 1024 };
+  static ipc_corr_id_t ids[CALLS];
+
+  ipc_duplex_t * server = ipc_duplex_create(DUPLEX_NAME, UNIT_SIZE, IPC_DUPLEX_SERVER);
+  assert(server != NULL);
+
+  pid_t caller = fork();
+  if (!caller)
+  {
+    ipc_duplex_t * client = ipc_duplex_create(DUPLEX_NAME, UNIT_SIZE, IPC_DUPLEX_CLIENT);
+
+    for (size_t i = 0; i < CALLS; i++)
+      ipc_duplex_send(client, &i);
+
+    exit(0);
+  }
+
+  size_t request;
+  for (size_t i = 0; i < CALLS; i++)
+    ids[i] = ipc_duplex_recv(server, &request);
+
+  join_child(caller);
+
+  for (size_t i = 0; i < CALLS; i++)
+    ipc_duplex_reply(server, ids[i], &request);
+
+  pid_t survivor = fork();
+  if (!survivor)
+  {
+    ipc_duplex_t * client = ipc_duplex_create(DUPLEX_NAME, UNIT_SIZE, IPC_DUPLEX_CLIENT);
+    size_t reply;
+
+    request = 42;
+    ipc_duplex_call(client, &request, &reply);
+    ipc_duplex_destroy(client);
+    exit(reply == 42 ? 0 : 1);
+  }
+
+  ipc_corr_id_t id = ipc_duplex_recv(server, &request);
+  ipc_duplex_reply(server, id, &request);
+
+  join_child(survivor);
+  ipc_duplex_destroy(server);
+}
+
+int main(void)
+{
+  setvbuf(stdout, NULL, _IONBF, 0);
+  alarm(TIMEOUT_SEC);
+
+  consumer_killed_in_wait();
+  printf("consumer killed in wait:          ok\n");
+
+  producer_killed_in_wait();
+  printf("producer killed in wait:          ok\n");
+
+  client_killed_in_wait();
+  printf("client killed in wait:            ok\n");
+
+  producer_killed_holding_lock();
+  printf("producer killed holding the lock: ok\n");
+
+  consumer_killed_holding_lock();
+  printf("consumer killed holding the lock: ok\n");
+
+  client_killed_holding_lock();
+  printf("client killed holding the lock:   ok\n");
+
+  replies_to_dead_callers();
+  printf("replies to dead callers:          ok\n");
+}